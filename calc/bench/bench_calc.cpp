@@ -0,0 +1,228 @@
+// Benchmarks of calc's kernels, from tokenizing a single entry up to a whole
+// log end to end. Build with optimizations and run from the build directory, e.g.
+//
+//      cmake -S . -B build -DCMAKE_BUILD_TYPE=Release && cmake --build build
+//      ./build/bench/calc_bench --benchmark_filter=EndToEnd
+//
+// and compare the numbers before and after a change to the engine.
+#include <string>
+#include <string_view>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <cstdio>
+#include <benchmark/benchmark.h>
+
+#include "calc.h"
+#include "event_parser.h"
+#include "histogram.h"
+#include "log_filter.h"
+#include "log_generator.h"
+#include "log_stats.h"
+#include "order_replay.h"
+#include "order_table.h"
+#include "ticks.h"
+#include "write2db.h"
+
+namespace {
+
+const char* ORDER_REPORT = "09:13:06.012430 11 [Trace][][OrderReport]Tradetron 09:13:06.011 779c0098490 g01Ot C703002017 5299 IntraDayOdd ROD Buy 109.5 223 0000=OrderSuccess RR";
+
+const TimeOfDay FIRST_CHECK_TIME = parseTimeOfDay("09:10:00").value();
+const TimeOfDay LAST_CHECK_TIME = parseTimeOfDay("13:24:50").value();
+
+// a log of <orders> orders over the session, about 2.5 entries per order, see LogGenerator
+std::string syntheticLog(size_t orders) {
+    LogGeneratorOptions options;
+    options.orders = orders;
+    options.strategies = {"C70", "C71"};
+    options.seed = 42;
+    LogGenerator generator(options);
+    std::string log;
+    std::string line;
+    while (generator.nextLine(line)) {
+        log += line;
+        log += '\n';
+    }
+    return log;
+}
+
+// the samples of a day at one second check points
+std::vector<ActiveOrderPair> daySamples() {
+    std::mt19937 random(7);
+    std::vector<ActiveOrderPair> samples;
+    for (TimeOfDay t : genCheckPoints(FIRST_CHECK_TIME, LAST_CHECK_TIME, MICROS_PER_SECOND)) {
+        (void)t;
+        samples.emplace_back(static_cast<int>(random() % 3000), static_cast<Ticks>(random() % 100000000));
+    }
+    return samples;
+}
+
+void BM_TokenizeLine(benchmark::State& state) {
+    std::string_view line = ORDER_REPORT;
+    LogFields fields;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(tokenizeLine(line, fields));
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(line.size()));
+}
+BENCHMARK(BM_TokenizeLine);
+
+void BM_ParseTimeOfDay(benchmark::State& state) {
+    std::string_view text = "09:13:06.012430";
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(parseTimeOfDay(text));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ParseTimeOfDay);
+
+void BM_ParsePriceTicks(benchmark::State& state) {
+    std::string_view text = "109.5";
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(parsePriceTicks(text));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ParsePriceTicks);
+
+void BM_ParseShares(benchmark::State& state) {
+    std::string_view text = "223";
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(parseUnsigned<int>(text));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ParseShares);
+
+void BM_LogFilterAccept(benchmark::State& state) {
+    LogFilter filter;
+    std::string_view line = ORDER_REPORT;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(filter.accept(line));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LogFilterAccept);
+
+void BM_ParseOrderEvent(benchmark::State& state) {
+    EventParser parser("20240520.ibfs", nullptr, false, true);
+    std::string_view line = ORDER_REPORT;
+    OrderEvent event;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(parser.read(line, event));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ParseOrderEvent);
+
+// insert one order and erase another, with state.range(0) orders live
+void BM_OrderTableUpdate(benchmark::State& state) {
+    const OrderKey live = static_cast<OrderKey>(state.range(0));
+    OrderTable table(static_cast<size_t>(live));
+    for (OrderKey key = 1; key <= live; ++key) {
+        table.insert(key, 100);
+    }
+    OrderKey next = live + 1;
+    for (auto _ : state) {
+        table.insert(next, 100);
+        table.erase(next - live);
+        ++next;
+    }
+    state.SetItemsProcessed(state.iterations() * 2);
+}
+BENCHMARK(BM_OrderTableUpdate)->Arg(1 << 10)->Arg(1 << 16);
+
+// one order update and a move of the clock, check points every state.range(0) ms
+void BM_OrderReplayAdvance(benchmark::State& state) {
+    const TimeOfDay interval = state.range(0) * 1000;
+    std::vector<OrderEvent> events(4096);
+    for (size_t i = 0; i < events.size(); ++i) {
+        events[i].orderId = packOrderId(std::to_string(i % 1024));
+        events[i].status = i % 2048 < 1024 ? 'O' : 'C';
+        events[i].price = 10950;
+        events[i].shares = 10;
+    }
+    OrderReplay replay(FIRST_CHECK_TIME, LAST_CHECK_TIME, {interval}, 4096);
+    TimeOfDay now = FIRST_CHECK_TIME;
+    size_t i = 0;
+    for (auto _ : state) {
+        OrderEvent& event = events[i++ % events.size()];
+        event.time = now += 1000; // 1ms between events
+        if (now > LAST_CHECK_TIME) {
+            state.PauseTiming();
+            replay = OrderReplay(FIRST_CHECK_TIME, LAST_CHECK_TIME, {interval}, 4096);
+            now = FIRST_CHECK_TIME;
+            state.ResumeTiming();
+        }
+        replay.advanceTo(event.time);
+        replay.apply(event);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_OrderReplayAdvance)->Arg(1000)->Arg(30000);
+
+void BM_ComputeStats(benchmark::State& state) {
+    std::vector<ActiveOrderPair> samples = daySamples();
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(computeStats("20240520.ibfs", samples, 100000, MICROS_PER_SECOND, {50, 90, 99, 99.9}));
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(samples.size()));
+}
+BENCHMARK(BM_ComputeStats)->Unit(benchmark::kMicrosecond);
+
+// a batch of state.range(0) days committed in one transaction, as calc -d does
+void BM_WriteStats(benchmark::State& state) {
+    std::string path = "calc_bench_write.db";
+    std::remove(path.c_str());
+    std::vector<ActiveOrderPair> samples = daySamples();
+    LogStats stats = computeStats("20240520.ibfs", samples, 100000, MICROS_PER_SECOND, {50, 90, 99, 99.9});
+    for (auto _ : state) {
+        LogStatsWriter writer(static_cast<size_t>(state.range(0)));
+        writer.open(path);
+        for (int day = 0; day < state.range(0); ++day) {
+            stats.date = 20240000 + day;
+            writer.insert(stats, "ibfs");
+        }
+        writer.close();
+    }
+    std::remove(path.c_str());
+    std::remove((path + "-wal").c_str());
+    std::remove((path + "-shm").c_str());
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_WriteStats)->Arg(1)->Arg(250)->Unit(benchmark::kMillisecond);
+
+// parse and replay a whole log of state.range(0) orders, as calc -f does once it has mapped the file
+void BM_EndToEnd(benchmark::State& state) {
+    std::string log = syntheticLog(static_cast<size_t>(state.range(0)));
+    int64_t entries = std::count(log.begin(), log.end(), '\n');
+    LogFilter filter;
+    filter.strategyPrefixes = {"C70"};
+    for (auto _ : state) {
+        EventParser parser("20240520.ibfs", &filter, false, true);
+        StrategyReplay replay(1, FIRST_CHECK_TIME, LAST_CHECK_TIME, {MICROS_PER_SECOND}, 4096);
+        OrderEvent event;
+        size_t pos = 0;
+        while (pos < log.size() && !replay.done()) {
+            size_t eol = log.find('\n', pos);
+            std::string_view line(log.data() + pos, eol - pos);
+            pos = eol + 1;
+            if (!parser.read(line, event))
+                continue;
+            replay.advanceTo(event.time);
+            if (!replay.done())
+                replay.apply(event);
+        }
+        benchmark::DoNotOptimize(replay.strategy(0).count());
+    }
+    state.SetItemsProcessed(state.iterations() * entries);
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(log.size()));
+}
+BENCHMARK(BM_EndToEnd)->Arg(400000)->Unit(benchmark::kMillisecond);
+
+} // namespace
+
+BENCHMARK_MAIN();
@@ -2,10 +2,12 @@
 
 ############################################################################
 # This script does two things
-# 1. Filter the logs in-place with only the information we really need (new order,
-#    cancel order, match report) for the specific strategy we want stats on.
-# 2. Run the corresponding program to calculate stats based on the pre-processed 
-#    log files.
+# 1. Make sure every log file is named YYYYMMDD.ibfs (YYYYMMDD.ibfs.gz if it
+#    is gzip-compressed, calc reads those directly)
+# 2. Run the corresponding program to calculate stats on the log files. calc
+#    filters the raw logs itself (-p <strategy>), keeping only the information
+#    we really need (new order, cancel order, match report), so the logs are
+#    read once and never rewritten.
 #
 # Prerequisites:
 # The log files under the designated dir must already be processed on Windows side
@@ -14,28 +16,28 @@
 # Path to the log directory (all files in this dir will be affected)
 log_dir="log"
 
+# Strategy we want stats on, a comma-separated list (e.g. "C70,C71") gives
+# every strategy its own table from the same read of the logs
+strategy="C70"
+
 # Check if the log directory exists
 if [ ! -d "$log_dir" ]; then
     echo "Error: Log directory not found: $log_dir"
     exit 1
 fi
 
-# Function to apply filters and save to temporary file
-apply_filters() {
-    local input_file="$1"
-    local temp_file="$input_file.temp"
-
-    # grep only the new/cancel/match lines for strategy C70
-    grep -a -E '.*OrderUpdate.*C70|.*OrderReport.*C70|.*\[MatchReport\].*IntraDayOdd.*Buy' "$input_file" > "$temp_file" || { echo "Error: Grep filter failed."; exit 1; }
-
-    # Overwrite the original file with the filtered content
-    mv "$temp_file" "$input_file" || { echo "Error: Failed to rename temporary file."; exit 1; }
-}
-
 check_and_rename_filename() {
     local filename="$1"
-    # check if filename matches YYYYMMDD.ibfs
-    if [[ "$filename" =~ ^([0-9]{8})\.ibfs$ ]]; then
+    # event caches written by calc (YYYYMMDD.ibfs.evc) are not logs, leave them alone
+    if [[ "$filename" == *.evc || "$filename" == *.evc.tmp ]]; then
+        return 0
+    fi
+    local suffix=""
+    if [[ "$filename" == *.gz ]]; then
+        suffix=".gz"
+    fi
+    # check if filename matches YYYYMMDD.ibfs[.gz]
+    if [[ "$filename" =~ ^([0-9]{8})\.ibfs(\.gz)?$ ]]; then
         local date_part="${BASH_REMATCH[1]}"
         # validate date
         if date -d "${date_part:0:4}-${date_part:4:2}-${date_part:6:2}" >/dev/null 2>&1; then
@@ -51,7 +53,7 @@ check_and_rename_filename() {
             local date_part="${BASH_REMATCH[1]}"
             # validate date_part
             if date -d "${date_part:0:4}-${date_part:4:2}-${date_part:6:2}" >/dev/null 2>&1; then
-                local new_filename="${date_part}.ibfs"
+                local new_filename="${date_part}.ibfs${suffix}"
                 mv "$filename" "$new_filename"
                 echo "Renamed '$filename' to '$new_filename'"
                 return 0
@@ -71,19 +73,14 @@ cd "$log_dir"
 for file in *; do
     # Check if there are any files
     if [ -e "$file" ]; then
-        # Apply filters to the file
-        apply_filters "$file"
         check_and_rename_filename "$file"
     fi
 done
 cd ..
 
-# Execute the program to collect stats with the appropriate arguments
-for file in "$log_dir"/*; do
-    if [ -e "$file" ]; then
-        ./bin/calc -f "$file" -s 1 -o "sql/oddlot.db"
-    fi
-done
-
-# Clean up temporary files (optional)
-rm -f "$log_dir"/*.temp
+# Execute the program to collect stats with the appropriate arguments, calc
+# spreads the files over all cores and commits every day's stats in one go.
+# Each log's events are cached next to it (<log>.evc), so reruns only parse
+# the logs that are new or have changed since. All intervals are sampled in
+# the same pass and stored as one row each.
+./bin/calc -d "$log_dir" -s 1,5,30,60 -p "$strategy" --write-cache -o "sql/oddlot.db"
@@ -1,13 +1,5 @@
-WITH Ordered AS (
-    SELECT 
-        meanAmount, 
-        ROW_NUMBER() OVER (ORDER BY meanAmount) AS row_num, 
-        COUNT(*) OVER () AS total_count
-    FROM ibfs
-)
-SELECT AVG(meanAmount) AS medianValue
-FROM Ordered
-WHERE row_num IN (
-    (total_count + 1) / 2, 
-    (total_count + 2) / 2
-);
+-- Median of the daily meanAmount per interval, kept by calc (see createPercentilesTableSQL() in src/cross_day_stats.h)
+SELECT intervalSeconds, value AS medianValue
+FROM ibfs_percentiles
+WHERE metric = 'meanAmount' AND percentile = 50
+ORDER BY intervalSeconds;
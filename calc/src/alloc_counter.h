@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+// Heap allocation counting, compiled in with CALC_COUNT_ALLOCATIONS (cmake
+// -DCALC_COUNT_ALLOCATIONS=ON for calc, always on for the tests). The global
+// operator new and delete, all of their forms (array, sized, aligned, nothrow),
+// are replaced by ones that count the allocations made by the calling thread,
+// so a piece of code can be shown to allocate nothing:
+//
+//      size_t before = allocationCount();
+//      parser.read(line, event);
+//      assert(allocationCount() == before);
+//
+// Replacing operator new is global, include this from one translation unit only.
+#if defined(CALC_COUNT_ALLOCATIONS)
+
+thread_local size_t threadAllocations = 0;
+
+// allocations made by the calling thread so far
+size_t allocationCount() {
+    return threadAllocations;
+}
+
+// Every replacement below allocates through countedAllocate() and frees through
+// countedFree(). Neither is inlined, so the compiler never pairs an inlined
+// std::free with an operator new it sees (-Wmismatched-new-delete).
+
+// <size> bytes aligned to <alignment>, or as std::malloc aligns them if 0; nullptr when out of memory
+[[gnu::noinline]] void* countedAllocate(std::size_t size, std::size_t alignment) noexcept {
+    ++threadAllocations;
+    if (size == 0)
+        size = 1;
+    if (alignment == 0)
+        return std::malloc(size);
+    return std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment); // a multiple of the alignment
+}
+
+[[gnu::noinline]] void countedFree(void* p) noexcept {
+    std::free(p);
+}
+
+[[gnu::noinline]] void* operator new(std::size_t size) {
+    if (void* p = countedAllocate(size, 0))
+        return p;
+    throw std::bad_alloc();
+}
+
+[[gnu::noinline]] void* operator new[](std::size_t size) {
+    if (void* p = countedAllocate(size, 0))
+        return p;
+    throw std::bad_alloc();
+}
+
+[[gnu::noinline]] void* operator new(std::size_t size, std::align_val_t alignment) {
+    if (void* p = countedAllocate(size, static_cast<std::size_t>(alignment)))
+        return p;
+    throw std::bad_alloc();
+}
+
+[[gnu::noinline]] void* operator new[](std::size_t size, std::align_val_t alignment) {
+    if (void* p = countedAllocate(size, static_cast<std::size_t>(alignment)))
+        return p;
+    throw std::bad_alloc();
+}
+
+[[gnu::noinline]] void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    return countedAllocate(size, 0);
+}
+
+[[gnu::noinline]] void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return countedAllocate(size, 0);
+}
+
+[[gnu::noinline]] void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return countedAllocate(size, static_cast<std::size_t>(alignment));
+}
+
+[[gnu::noinline]] void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return countedAllocate(size, static_cast<std::size_t>(alignment));
+}
+
+[[gnu::noinline]] void operator delete(void* p) noexcept {
+    countedFree(p);
+}
+
+[[gnu::noinline]] void operator delete[](void* p) noexcept {
+    countedFree(p);
+}
+
+[[gnu::noinline]] void operator delete(void* p, std::size_t) noexcept {
+    countedFree(p);
+}
+
+[[gnu::noinline]] void operator delete[](void* p, std::size_t) noexcept {
+    countedFree(p);
+}
+
+[[gnu::noinline]] void operator delete(void* p, std::align_val_t) noexcept {
+    countedFree(p);
+}
+
+[[gnu::noinline]] void operator delete[](void* p, std::align_val_t) noexcept {
+    countedFree(p);
+}
+
+[[gnu::noinline]] void operator delete(void* p, std::size_t, std::align_val_t) noexcept {
+    countedFree(p);
+}
+
+[[gnu::noinline]] void operator delete[](void* p, std::size_t, std::align_val_t) noexcept {
+    countedFree(p);
+}
+
+[[gnu::noinline]] void operator delete(void* p, const std::nothrow_t&) noexcept {
+    countedFree(p);
+}
+
+[[gnu::noinline]] void operator delete[](void* p, const std::nothrow_t&) noexcept {
+    countedFree(p);
+}
+
+[[gnu::noinline]] void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept {
+    countedFree(p);
+}
+
+[[gnu::noinline]] void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept {
+    countedFree(p);
+}
+
+#endif
@@ -1,15 +1,30 @@
 #include <iostream>
-#include <fstream>
 #include <string>
+#include <string_view>
 #include <vector>
-#include <unordered_map>
+#include <array>
 #include <algorithm>
 #include <numeric>
 #include <cmath>
 #include <unistd.h>
 #include <optional>
+#include <thread>
+#include <fstream>
+#include <chrono>
+#include <csignal>
+#include <getopt.h>
 
 #include "calc.h"
+#include "event_parser.h"
+#include "gzip_log.h"
+#include "histogram.h"
+#include "log_filter.h"
+#include "log_stats.h"
+#include "order_table.h"
+#include "process_log.h"
+#include "run_metrics.h"
+#include "ticks.h"
+#include "warning_log.h"
 #include "write2db.h"
 
 /****************************
@@ -24,132 +39,200 @@
  * 前處理完後再將檔案放到Linux上
  * 然後再用grep來過濾掉不要的log
  * $ grep -a -E '.*OrderUpdate.*C70|.*OrderReport.*C70|.*\[MatchReport\].*IntraDayOdd.*Buy' 20240520-19396.txt > log
- * *************************/
-
-using ActiveOrderPair = std::pair<int, double>; // <number of active orders, total order amount>
-
-/*
- * Given a single log entry and a key that is contained, return the next n-th entry.
- * For simplicity, user must ensure that the key provided exists in the entry
- * and that the next n-th entry is not passed the end.
  *
- * There are two types of input, one is OrderReport and the other is OrderUpdate
- * Example on OrderReport:
- * 09:13:06.012430 11 [Trace][][OrderReport]Tradetron 09:13:06.011 779c0098490 g01Ot C703002017 5299 IntraDayOdd ROD Buy 109.5 223 0000=OrderSuccess RR 
+ * 或者不做grep, 直接用 -p 讓calc自己過濾 (見 log_filter.h)
+ * $ ./bin/calc -f 20240520.ibfs -p C70 -o sql/oddlot.db
  *
- * Example on OrderUpdate:
- * 09:13:01.021246 11 [Trace][][OrderUpdate]Tradetron 09:13:01.003 779c0098490 g01Cs C703001699 2615 IntraDayOdd ROD Buy 63.8 999 0000=CancelSuccess RR 
-*/
-
-LogStats computeStats(std::string filename, std::vector<ActiveOrderPair> &data, const std::vector<std::string> &checkTimes, int count, int secondsPerInterval)
-{
-    size_t size = data.size();
-    size_t dotPos = filename.find_last_of('.'); // we might have relative path in fron (../dir/filename) hence use last of 
-    LogStats ret;
-    ret.date = dotPos == std::string::npos ? 0 : stoi(filename.substr(dotPos - 8, 8));
-    ret.tt = dotPos == std::string::npos ? "" : filename.substr(dotPos + 1);
-    ret.numberOfLogs = count;
-
-    // find max and its index then display max
-    auto maxIter = std::max_element(data.begin(), data.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
-    int maxIdx = std::distance(data.begin(), maxIter);
-    ret.maxActiveOrders = data[maxIdx].first;
-
-    double mean_orders = 0.0;
-    double variance_order = 0.0;
-    int n = 0;
-    for (const auto& pair : data) {
-        ++n;
-        double delta = pair.first - mean_orders;
-        mean_orders += delta / n;
-        variance_order += delta * (pair.first - mean_orders);
-    }
-    variance_order /= n;
-    double stddev_orders = std::sqrt(variance_order);
-    ret.meanActiveOrders = mean_orders;
-    ret.stddevActiveOrders = stddev_orders;
-    double median_order = 0.0;
-    std::sort(data.begin(), data.end(), [](const ActiveOrderPair& a, const ActiveOrderPair& b) { return a.first < b.first; });
-    if (size % 2 == 0) {
-        median_order = (data[size / 2].first + data[size / 2 + 1].first) / 2.0;
-    } else {
-        median_order = data[size / 2 + 1].first;
-    }
-    ret.medianActiveOrders = median_order;
-
-    // Calculate mean and standard deviation incrementally to avoid overflow
-    double mean_amount = 0.0;
-    double variance_amount = 0.0;
-    n = 0;
-    for (const auto& pair : data) {
-        ++n;
-        double delta = pair.second - mean_amount;
-        mean_amount += delta / n;
-        variance_amount += delta * (pair.second - mean_amount);
-    }
-    // finalize variance and calculate standard deviation
-    variance_amount /= n;
-    double stddev_amount = std::sqrt(variance_amount);
-    ret.meanAmount = mean_amount;
-    ret.stddevAmount = stddev_amount;
-
-    // Now we sort the array in order to find median
-    double median_amount = 0.0;
-    std::sort(data.begin(), data.end(), [](const ActiveOrderPair& a, const ActiveOrderPair& b) { return a.second < b.second; });
-    if (size % 2 == 0) {
-        median_amount = (data[size / 2].second + data[size / 2 + 1].second) / 2.0;
-    } else {
-        median_amount = data[size / 2 + 1].second;
-    }
-    ret.maxAmount = data[size-1].second;
-    ret.medianAmount = median_amount;
-    ret.minAmount = data[0].second;
-    return ret;
-} 
+ * 多個策略用逗號分開, 讀一次log, 每個策略各自一個table (ibfs_C70, ibfs_C71)
+ * $ ./bin/calc -f 20240520.ibfs -p C70,C71 -o sql/oddlot.db
+ * *************************/
 
-void showStats(const LogStats &stats, int sampleRate) {
+void showStats(const LogStats &stats) {
     std::cout << "date = " << stats.date << std::endl;
-    std::cout << "sampling every " << sampleRate << " second(s)" << std::endl;
+    if (!stats.strategy.empty())
+        std::cout << "strategy " << stats.strategy << std::endl;
+    std::cout << "sampling every " << stats.intervalSeconds << " second(s)" << std::endl;
     std::cout << "processed " << stats.numberOfLogs << " entries" << std::endl;
     std::cout << "activeOrders: [max=" << stats.maxActiveOrders << "] ";
     std::cout << "[mean=" << stats.meanActiveOrders << "] ";
     std::cout << "[median=" << stats.medianActiveOrders << "] ";
+    for (size_t i = 0; i < stats.percentiles.size(); ++i) {
+        std::cout << "[" << percentileColumn(stats.percentiles[i], "") << "=" << stats.activeOrdersPercentiles[i] << "] ";
+    }
     std::cout << "[stddev=" << stats.stddevActiveOrders << "]" << std::endl;
-    std::cout << "orderAmount: [max=" << stats.maxAmount << "] ";
-    std::cout << "[mean=" << stats.meanAmount << "] ";
-    std::cout << "[median=" << stats.medianAmount << "] ";
-    std::cout << "[min=" << stats.minAmount << "] ";
-    std::cout << "[stddev=" << stats.stddevAmount << "]" << std::endl;
+    std::cout << "orderAmount: [max=" << ticksToUnits(stats.maxAmount) << "] ";
+    std::cout << "[mean=" << ticksToUnits(stats.meanAmount) << "] ";
+    std::cout << "[median=" << ticksToUnits(stats.medianAmount) << "] ";
+    std::cout << "[min=" << ticksToUnits(stats.minAmount) << "] ";
+    for (size_t i = 0; i < stats.percentiles.size(); ++i) {
+        std::cout << "[" << percentileColumn(stats.percentiles[i], "") << "=" << ticksToUnits(stats.amountPercentiles[i]) << "] ";
+    }
+    std::cout << "[stddev=" << ticksToUnits(stats.stddevAmount) << "]" << std::endl;
+    for (const auto& top : stats.topSymbols) {
+        std::cout << "symbol " << top.symbol << ": [peakAmount=" << ticksToUnits(top.peakAmount) << "] [at=" << top.peakTime << "] ";
+        std::cout << "[activeOrders=" << top.activeOrders << "]" << std::endl;
+    }
 }
 
 int printUsage(char *progname)
 {
-    std::cerr << "Usage: " << progname << " [-v] [-f filename] [-s intervalSeconds] [-o outputDB]" << std::endl;
+    std::cerr << "Usage: " << progname << " [-v] [-f filename [--follow] | -d logDir] [--write-cache] [--series] [-s intervalSeconds[,...]] [-o outputDB] [-p strategyPrefix[,...]] [-n expectedOrders] [-P percentiles] [-t topSymbols] [-j threads]" << std::endl;
+    std::cerr << "       [--metrics file] [--metrics-table] [--warn-limit burst[,sampleEvery]]" << std::endl;
+    std::cerr << "  -s  seconds between check points, fractions such as 0.5 are allowed (default 30). A comma-separated" << std::endl;
+    std::cerr << "      list such as 1,5,30,60 samples every interval in the same pass and stores one row per interval" << std::endl;
+    std::cerr << "  -f  log to process, gzip-compressed logs (*.gz) are decompressed on the fly and event caches (*.evc) replayed" << std::endl;
+    std::cerr << "  -d  process every YYYYMMDD.<ext>[.gz] log in logDir in parallel and write all stats at once," << std::endl;
+    std::cerr << "      logs with an up-to-date event cache are replayed from the cache" << std::endl;
+    std::cerr << "  -j  threads parsing each log (default 1, 0 for one per core), for logs that are neither" << std::endl;
+    std::cerr << "      gzip-compressed nor followed; the replay of the parsed events stays sequential. With -d the" << std::endl;
+    std::cerr << "      threads are shared out among the logs processed at once (one per core), so -j 0 does not start" << std::endl;
+    std::cerr << "      more threads than cores" << std::endl;
+    std::cerr << "  -n  number of simultaneously active orders to size the order table for (default 4096)" << std::endl;
+    std::cerr << "  -P  comma-separated percentiles to report and store (default 50,90,99,99.9)" << std::endl;
+    std::cerr << "  -t  number of symbols with the highest peak amount to report and store in <table>_symbols per" << std::endl;
+    std::cerr << "      interval (default 10), 0 to not track symbols" << std::endl;
+    std::cerr << "  -p  filter a raw (un-grepped) log on the fly, keeping only entries of the given strategy. With a" << std::endl;
+    std::cerr << "      comma-separated list such as C70,C71 every strategy gets its own stats and table (e.g. ibfs_C70)" << std::endl;
+    std::cerr << "  --follow  keep reading the -f log as it is written and print every sample as its check point passes," << std::endl;
+    std::cerr << "            until the last check point (or SIGINT/SIGTERM), then store the stats as usual" << std::endl;
+    std::cerr << "  --write-cache  also save the events of every text log read to <log>.evc, so later runs (e.g. at another" << std::endl;
+    std::cerr << "                 interval) replay those instead of parsing the log again" << std::endl;
+    std::cerr << "  --series  also store the active orders and amount at every check point in <table>_series" << std::endl;
+    std::cerr << "  --metrics  write how long each phase (open, parse, replay, stats, write) took, lines and bytes read," << std::endl;
+    std::cerr << "             warnings by kind and the peak of active orders as JSON to file, - for standard output" << std::endl;
+    std::cerr << "  --metrics-table  also store those metrics, one row per log, in the run_metrics table of outputDB" << std::endl;
+    std::cerr << "  --warn-limit  print the first <burst> warnings of each kind, then about 1 in <sampleEvery> (default 100,1000," << std::endl;
+    std::cerr << "                0 to print every warning); a count of each kind is printed at the end either way" << std::endl;
     return 1;
 }
 
 int main(int argc, char* argv[])
 {
-    bool verbose = false;
+    CalcOptions options;
     std::string filename;
+    std::string logDir;
     std::string outputDB;
+    std::string metricsPath;   // where to write the JSON summary of the run, "-" for stdout, empty for none
+    bool storeMetrics = false; // also store the metrics of every log in the run_metrics table of outputDB
+    WarningLimits warningLimits;
     int opt;
-    int secondsPerInterval = 0;
 
-    while ((opt = getopt(argc, argv, "vf:s:o:h")) != -1) {
+    const struct option longOptions[] = {
+        {"follow", no_argument, nullptr, 'F'},
+        {"write-cache", no_argument, nullptr, 'W'},
+        {"series", no_argument, nullptr, 'S'},
+        {"metrics", required_argument, nullptr, 'M'},
+        {"metrics-table", no_argument, nullptr, 'T'},
+        {"warn-limit", required_argument, nullptr, 'L'},
+        {nullptr, 0, nullptr, 0}
+    };
+
+    while ((opt = getopt_long(argc, argv, "vf:d:s:o:p:n:P:t:j:h", longOptions, nullptr)) != -1) {
         switch(opt) {
             case 'v':
-                verbose = true;
+                options.verbose = true;
                 break;
             case 'f':
                 filename = optarg;
                 break;
+            case 'd':
+                logDir = optarg;
+                break;
             case 'o':
                 outputDB = optarg;
                 break;
             case 's':
-                secondsPerInterval = std::stoi(optarg);
+            {
+                std::optional<std::vector<TimeOfDay>> intervals = parseDurations(optarg);
+                if (!intervals.has_value()) {
+                    std::cerr << "Invalid interval list (comma-separated seconds, fractions allowed): " << optarg << std::endl;
+                    return printUsage(argv[0]);
+                }
+                options.intervals = intervals.value();
+                break;
+            }
+            case 'n':
+            {
+                std::optional<size_t> expected = parseUnsigned<size_t>(optarg);
+                if (!expected.has_value()) {
+                    std::cerr << "Invalid number of expected orders: " << optarg << std::endl;
+                    return printUsage(argv[0]);
+                }
+                options.expectedOrders = expected.value();
+                break;
+            }
+            case 'j':
+            {
+                std::optional<size_t> jobs = parseUnsigned<size_t>(optarg);
+                if (!jobs.has_value()) {
+                    std::cerr << "Invalid number of threads: " << optarg << std::endl;
+                    return printUsage(argv[0]);
+                }
+                options.jobs = jobs.value() > 0 ? jobs.value() : std::max(1u, std::thread::hardware_concurrency());
+                break;
+            }
+            case 't':
+            {
+                std::optional<size_t> top = parseUnsigned<size_t>(optarg);
+                if (!top.has_value()) {
+                    std::cerr << "Invalid number of top symbols: " << optarg << std::endl;
+                    return printUsage(argv[0]);
+                }
+                options.topSymbols = top.value();
+                break;
+            }
+            case 'P':
+            {
+                std::optional<std::vector<double>> percentiles = parsePercentiles(optarg);
+                if (!percentiles.has_value()) {
+                    std::cerr << "Invalid percentile list (comma-separated, each in [0, 100]): " << optarg << std::endl;
+                    return printUsage(argv[0]);
+                }
+                options.percentiles = percentiles.value();
+                break;
+            }
+            case 'p':
+            {
+                std::optional<std::vector<std::string>> prefixes = parseStrategyPrefixes(optarg);
+                if (!prefixes.has_value()) {
+                    std::cerr << "Invalid strategy prefix list (comma-separated, letters, digits and '_' only, at most " <<
+                        MAX_STRATEGIES << "): " << optarg << std::endl;
+                    return printUsage(argv[0]);
+                }
+                options.filterLog = true;
+                options.filter.strategyPrefixes = prefixes.value();
+                break;
+            }
+            case 'F':
+                options.follow = true;
+                break;
+            case 'W':
+                options.writeCache = true;
+                break;
+            case 'S':
+                options.storeSeries = true;
                 break;
+            case 'M':
+                metricsPath = optarg;
+                break;
+            case 'T':
+                storeMetrics = true;
+                break;
+            case 'L':
+            {
+                std::string_view limits = optarg;
+                size_t comma = limits.find(',');
+                std::optional<uint64_t> burst = parseUnsigned<uint64_t>(limits.substr(0, comma));
+                std::optional<uint64_t> sampleEvery = comma == std::string_view::npos ?
+                    warningLimits.sampleEvery : parseUnsigned<uint64_t>(limits.substr(comma + 1));
+                if (!burst.has_value() || !sampleEvery.has_value()) {
+                    std::cerr << "Invalid warning limit (burst[,sampleEvery]): " << optarg << std::endl;
+                    return printUsage(argv[0]);
+                }
+                warningLimits.burst = burst.value();
+                warningLimits.sampleEvery = sampleEvery.value();
+                break;
+            }
             case 'h':
                 return printUsage(argv[0]);
             default:
@@ -157,112 +240,54 @@ int main(int argc, char* argv[])
         }
     }
 
-    if (filename.empty() || outputDB.empty()) {
+    if (filename.empty() == logDir.empty() || outputDB.empty()) {
+        return printUsage(argv[0]); // need exactly one of -f and -d
+    }
+    if (options.follow && (filename.empty() || isGzipPath(filename))) {
+        std::cerr << "--follow needs a plain log that is being written, given with -f" << std::endl;
         return printUsage(argv[0]);
     }
-    if (secondsPerInterval == 0) {
-        secondsPerInterval = 30; // default use 30 seconds
+    if (options.follow) {
+        std::signal(SIGINT, requestStopFollowing);
+        std::signal(SIGTERM, requestStopFollowing);
     }
-
-    std::unordered_map<std::string, int> activeOrders;  // <orderId, qty>
-    std::vector<std::string> checkTimes = genCheckPoints("09:10:00", "13:24:50", secondsPerInterval);
-    size_t totalCheckPoints = checkTimes.size();
-
-    int idx = 0; // the index of time points, e.g. checkPoints has time1, time2, time3, ... etc in crono order. time1 has index 0
-    std::vector<bool> indexStatus = std::vector<bool>(totalCheckPoints, false);
-    std::vector<ActiveOrderPair> activeOrdersAtCheckTime = std::vector<ActiveOrderPair>(checkTimes.size(), ActiveOrderPair(0, 0.0));
-
-    std::ifstream inputLog(filename);
-    if (!inputLog)
-    {
-        std::cerr << "Failed to open log (filename from user input = " << filename << std::endl;
+    std::string runAt = formatRunTime(std::chrono::system_clock::now());
+    MetricsClock::time_point runStart = MetricsClock::now();
+    std::vector<RunMetrics> metrics(1);
+    WarningLog warnings(warningLimits);
+    options.warnings = &warnings;
+    std::vector<LogStats> stats = logDir.empty() ? processLog(filename, options, metrics[0]) : processLogDir(logDir, options, metrics);
+    warnings.close();
+    std::cout << warnings.summary();
+    if (stats.empty() && logDir.empty()) {
         return 1;
     }
-    std::string line;
-    int count = 0;
-    double amount = 0;
-    float price = 0;
-    int shares = 0;
+    for (const auto& s : stats) {
+        showStats(s);
+    }
+    RunMetrics total;
+    PhaseTimer writeTimer(total, Phase::Write);
+    int result = write2db(stats, outputDB);
+    writeTimer.stop();
+    if (metricsPath.empty() && !storeMetrics)
+        return result;
 
-    while (getline(inputLog, line)) {
-        if (line.length() <= 80)
-            continue;
-        std::string currSec = line.substr(0, 8);
-        std::string orderId = line.substr(76, 5);
-        double prz = 0.0;
-        double rounded = 0.0;
-        char status;
-        if (line.find("MatchReport") != std::string::npos) {
-            status = 'M';
-        } else {
-            size_t statusPos = line.find('=');
-            if (statusPos == std::string::npos)
-            {
-                std::cout << "[WARN] parsing error in file " << filename << " line: " << line << std::endl;
-                continue;
-            }
-            status = line[statusPos+1];
-        }
-        switch (status)
-        {
-            case 'O': // new order
-            case 'C': // cancel order
-            case 'M': // match report
-            {
-                std::optional<std::string> ret_price = getNextNthEntry(line, "Buy", 1);
-                std::optional<std::string> ret_shares = getNextNthEntry(line, "Buy", 2);
-                if (ret_price.has_value()) {
-                    prz = stod(ret_price.value());
-                    rounded = std::round(prz * 100) / 100.0;
-                    price = static_cast<float>(rounded);
-                } else {
-                    std::cout << "[WARN] unable to find matching price in line: " << line << std::endl;
-                    break;
-                }
-                if (ret_shares.has_value()) {
-                    shares = stoi(ret_shares.value());
-                } else {
-                    std::cout << "[WARN] unable to find matching shares in line: " << line << std::endl;
-                    break;
-                }
-                if (status == 'O') {
-                    amount += price * shares;
-                    activeOrders.insert(std::make_pair(orderId, shares));
-                } else if (status == 'C') {
-                    amount -= price * shares;
-                    activeOrders.erase(orderId);
-                } else {
-                    if (activeOrders.find(orderId) != activeOrders.end()) {
-                        amount -= price * shares;
-                        activeOrders[orderId] -= shares;
-                        if (activeOrders[orderId] == 0) {
-                            activeOrders.erase(orderId); // no qty remaining, remove it
-                        }
-                    }
-                }
-                ++count;
-                break;
-            }
-            default:
-                std::cout << "[WARN] unable to find matching status in line: " << line << std::endl;
-                break;
-        }
-        // if this log entry is ahead of the checkTimePoint, use it until the checkTimePoint is ahead
-        while (idx < checkTimes.size() && currSec.compare(checkTimes[idx]) > 0 && indexStatus[idx] == false)
-        {
-            if (verbose) {
-                std::cout << "currSec=" << currSec << " checkTime=" << checkTimes[idx] <<
-                " [Active orders: " << activeOrders.size() << "] [Amount: " << amount << "]" << std::endl;
-            }
-            activeOrdersAtCheckTime[idx] = std::make_pair(activeOrders.size(), amount);
-            indexStatus[idx] = true;
-            idx++;
+    for (const auto& m : metrics) {
+        total.merge(m);
+    }
+    double elapsedSeconds = static_cast<double>(nanosSince(runStart)) / 1e9;
+    if (metricsPath == "-") {
+        std::cout << runMetricsJson(runAt, elapsedSeconds, metrics, total) << std::flush;
+    } else if (!metricsPath.empty()) {
+        std::ofstream out(metricsPath);
+        if (!(out << runMetricsJson(runAt, elapsedSeconds, metrics, total))) {
+            std::cerr << "Failed to write metrics to " << metricsPath << std::endl;
+            result = 1;
         }
-        if (indexStatus[totalCheckPoints - 1])
-            break; // if done no need to keep parsing the remaining log entries 
     }
-    auto ret = computeStats(filename, activeOrdersAtCheckTime, checkTimes, count, secondsPerInterval);
-    showStats(ret, secondsPerInterval);
-    write2db(ret, ret.tt, outputDB);
-    return 0;
+    if (storeMetrics && writeRunMetrics(runAt, elapsedSeconds, metrics, total, outputDB) != 0) {
+        result = 1;
+    }
+    return result;
 }
+
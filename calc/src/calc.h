@@ -1,5 +1,16 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
 #include <vector>
 #include <string>
+#include <string_view>
 #include <optional>
 
 const char sep = ' ';
@@ -12,23 +23,24 @@ const char sep = ' ';
 //      <input> is a space-separated string
 //      <key> is a key that's contained within the input (if not, nullopt is returned)
 //      <n> is the next nth item to find
-std::optional<std::string> getNextNthEntry(const std::string& input, const std::string& key, int n) {
+//
+// The returned entry is a view into <input>, so <input> must outlive it.
+std::optional<std::string_view> getNextNthEntry(std::string_view input, std::string_view key, int n) {
     size_t pos = 0;
-    while (pos != std::string::npos) {
+    while (pos != std::string_view::npos) {
         size_t start = input.find_first_not_of(sep, pos);
-        if (start == std::string::npos) break;
+        if (start == std::string_view::npos) break;
         
         size_t end = input.find_first_of(sep, start);
-        if (end == std::string::npos) break;
-        std::string word = input.substr(start, end - start);
+        if (end == std::string_view::npos) break;
+        std::string_view word = input.substr(start, end - start);
         if (word == key) {
             // skip the first n-1 entries
             for (int i = 0; i < n; ++i) {
                 size_t next_start = input.find_first_not_of(sep, end);
-                if (next_start == std::string::npos) break;
+                if (next_start == std::string_view::npos) break;
 
                 size_t next_end = input.find_first_of(sep, next_start);
-                if (next_end == std::string::npos) input.size()-1;
                 if (i == n - 1) {
                     return input.substr(next_start, next_end - next_start);
                 }
@@ -40,6 +52,220 @@ std::optional<std::string> getNextNthEntry(const std::string& input, const std::
     return std::nullopt;
 }
 
+// Index of each field that tokenizeLine() extracts from a log entry, e.g. fields[Field::Price]
+struct Field {
+    enum : size_t {
+        Timestamp,  // 09:13:06.012430
+        Thread,     // 11
+        Tag,        // [Trace][][OrderReport]Tradetron
+        Strategy,   // C703002017
+        Symbol,     // 5299
+        Side,       // Buy
+        Price,      // 109.5
+        Qty,        // 223
+        Status,     // 0000=OrderSuccess
+        Count
+    };
+};
+
+using LogFields = std::array<std::string_view, Field::Count>;
+
+// Split a log entry into its fields in a single pass, without copying anything.
+// The first three entries are the timestamp, thread and tag. The side ("Buy" or
+// "Sell") anchors the rest: strategy and symbol are the fourth and third entries
+// before it, price, qty and status the three entries after it.
+//
+// For example, tokenizing
+// "09:13:06.012430 11 [Trace][][OrderReport]Tradetron 09:13:06.011 779c0098490 g01Ot C703002017 5299 IntraDayOdd ROD Buy 109.5 223 0000=OrderSuccess RR"
+// gives fields[Field::Symbol] == "5299" and fields[Field::Price] == "109.5"
+//
+// Arguments:
+//      <line> is a single space-separated log entry
+//      <fields> receives views into <line>, fields not present are left empty
+//
+// Returns true if the side and the price and qty following it were all found
+bool tokenizeLine(std::string_view line, LogFields& fields) {
+    fields.fill(std::string_view());
+    std::array<std::string_view, 4> prev; // most recent entries before the side, prev[0] is the latest
+    size_t idx = 0;       // index of the current entry within the line
+    size_t afterSide = 0; // entries seen after the side
+    size_t pos = 0;
+    const size_t size = line.size();
+    while (pos < size) {
+        while (pos < size && line[pos] == sep) ++pos;
+        if (pos == size) break;
+        size_t end = pos;
+        while (end < size && line[end] != sep) ++end;
+        std::string_view word = line.substr(pos, end - pos);
+        pos = end;
+
+        if (idx <= Field::Tag) {
+            fields[idx] = word; // Timestamp, Thread and Tag are the leading entries
+        } else if (fields[Field::Side].empty()) {
+            if (word == "Buy" || word == "Sell") {
+                fields[Field::Side] = word;
+                fields[Field::Strategy] = prev[3];
+                fields[Field::Symbol] = prev[2];
+            } else {
+                prev = {word, prev[0], prev[1], prev[2]};
+            }
+        } else {
+            fields[Field::Price + afterSide] = word;
+            if (++afterSide == 3) break; // Price, Qty and Status found, ignore the rest
+        }
+        ++idx;
+    }
+    return !fields[Field::Qty].empty();
+}
+
+// Parse a whole non-negative number spanning all of <text> (e.g. a qty field),
+// straight from the view with std::from_chars: no allocation, no locale and no
+// exception on malformed input
+//
+// For example, parseUnsigned<int>("223") returns 223, parseUnsigned<int>("22x") returns nullopt
+//
+// Returns nullopt if <text> is empty, has anything but digits or does not fit into T
+template <typename T>
+std::optional<T> parseUnsigned(std::string_view text) {
+    if (text.empty() || text[0] < '0' || text[0] > '9')
+        return std::nullopt; // from_chars would accept a sign for signed T
+    T value{};
+    const char* end = text.data() + text.size();
+    auto result = std::from_chars(text.data(), end, value);
+    if (result.ec != std::errc() || result.ptr != end)
+        return std::nullopt;
+    return value;
+}
+
+// Time of day in microseconds since midnight, the unit of every timestamp and
+// check point in calc. Unlike HH:MM:SS strings it can express sub-second check
+// points and compares with a single integer comparison.
+using TimeOfDay = int64_t;
+
+const TimeOfDay MICROS_PER_SECOND = 1000000;
+
+// Parse a time of day in HH:MM:SS format with an optional fraction of a second
+// (HH:MM:SS.ffffff, digits beyond microseconds are ignored)
+//
+// For example, parseTimeOfDay("09:13:06.012430") returns 33186012430
+//
+// Returns nullopt if <text> is not a valid time of day
+std::optional<TimeOfDay> parseTimeOfDay(std::string_view text) {
+    auto digit = [&text](size_t i) { return text[i] >= '0' && text[i] <= '9'; };
+    if (text.size() < 8 || text[2] != ':' || text[5] != ':' ||
+        !digit(0) || !digit(1) || !digit(3) || !digit(4) || !digit(6) || !digit(7))
+        return std::nullopt;
+    int hour = (text[0] - '0') * 10 + (text[1] - '0');
+    int minute = (text[3] - '0') * 10 + (text[4] - '0');
+    int second = (text[6] - '0') * 10 + (text[7] - '0');
+    if (hour > 23 || minute > 59 || second > 59)
+        return std::nullopt;
+    TimeOfDay micros = 0;
+    if (text.size() > 8) {
+        if (text[8] != '.' || text.size() == 9)
+            return std::nullopt;
+        TimeOfDay scale = MICROS_PER_SECOND;
+        for (size_t i = 9; i < text.size(); ++i) {
+            if (!digit(i))
+                return std::nullopt;
+            scale /= 10;
+            micros += (text[i] - '0') * scale;
+        }
+    }
+    return (hour * 3600 + minute * 60 + second) * MICROS_PER_SECOND + micros;
+}
+
+// Parse a duration given in (possibly fractional) seconds, e.g. "30" or "0.25"
+//
+// Returns the duration in microseconds, nullopt if <text> is not a positive number
+// of seconds with at most microsecond resolution
+std::optional<TimeOfDay> parseDuration(std::string_view text) {
+    TimeOfDay seconds = 0;
+    TimeOfDay micros = 0;
+    size_t i = 0;
+    for (; i < text.size() && text[i] >= '0' && text[i] <= '9'; ++i) {
+        seconds = seconds * 10 + (text[i] - '0');
+        if (seconds > 86400)
+            return std::nullopt; // longer than a day
+    }
+    if (i < text.size() && text[i] == '.') {
+        TimeOfDay scale = MICROS_PER_SECOND;
+        for (++i; i < text.size() && text[i] >= '0' && text[i] <= '9'; ++i) {
+            scale /= 10;
+            micros += (text[i] - '0') * scale;
+        }
+    }
+    if (i != text.size() || seconds * MICROS_PER_SECOND + micros <= 0)
+        return std::nullopt;
+    return seconds * MICROS_PER_SECOND + micros;
+}
+
+// Parse a comma-separated list of durations in seconds (see parseDuration), e.g. "1,5,30,60"
+//
+// Returns the durations in ascending order without duplicates, or nullopt if any entry is invalid
+std::optional<std::vector<TimeOfDay>> parseDurations(const std::string& text) {
+    std::vector<TimeOfDay> durations;
+    size_t pos = 0;
+    while (pos <= text.size()) {
+        size_t end = text.find(',', pos);
+        if (end == std::string::npos)
+            end = text.size();
+        std::optional<TimeOfDay> duration = parseDuration(std::string_view(text).substr(pos, end - pos));
+        if (!duration.has_value())
+            return std::nullopt;
+        durations.push_back(duration.value());
+        pos = end + 1;
+    }
+    std::sort(durations.begin(), durations.end());
+    durations.erase(std::unique(durations.begin(), durations.end()), durations.end());
+    return durations;
+}
+
+// Local wall-clock time of day, the clock the log timestamps are written in
+TimeOfDay currentTimeOfDay() {
+    auto now = std::chrono::system_clock::now();
+    std::time_t seconds = std::chrono::system_clock::to_time_t(now);
+    std::tm local{};
+    localtime_r(&seconds, &local);
+    auto micros = std::chrono::duration_cast<std::chrono::microseconds>(now.time_since_epoch()).count() % MICROS_PER_SECOND;
+    return (local.tm_hour * 3600 + local.tm_min * 60 + local.tm_sec) * MICROS_PER_SECOND + micros;
+}
+
+// Format a time of day as HH:MM:SS, followed by .ffffff if it is not a whole second
+std::string formatTimeOfDay(TimeOfDay time) {
+    int totalSeconds = static_cast<int>(time / MICROS_PER_SECOND);
+    int micros = static_cast<int>(time % MICROS_PER_SECOND);
+    char buffer[32]; // room for any int fields, so snprintf never truncates
+    if (micros == 0) {
+        snprintf(buffer, sizeof(buffer), "%02d:%02d:%02d", totalSeconds / 3600, (totalSeconds % 3600) / 60, totalSeconds % 60);
+    } else {
+        snprintf(buffer, sizeof(buffer), "%02d:%02d:%02d.%06d", totalSeconds / 3600, (totalSeconds % 3600) / 60, totalSeconds % 60, micros);
+    }
+    return buffer;
+}
+
+// Given startTime and endTime in microseconds since midnight, return a list of
+// check points starting from startTime and no later than endTime with each
+// check point being intervalMicros later than the previous one (ascending).
+//
+// For example, genCheckPoints(0, 1000000, 250000) returns
+// {0, 250000, 500000, 750000, 1000000}
+//
+// Arguments:
+//      <startTime> is the start time in microseconds since midnight
+//      <endTime> is the end time in microseconds since midnight
+//      <intervalMicros> is the number of microseconds from current check point to the next
+std::vector<TimeOfDay> genCheckPoints(TimeOfDay startTime, TimeOfDay endTime, TimeOfDay intervalMicros) {
+    std::vector<TimeOfDay> checkpoints;
+    if (intervalMicros <= 0 || endTime < startTime)
+        return checkpoints;
+    checkpoints.reserve((endTime - startTime) / intervalMicros + 1);
+    for (TimeOfDay time = startTime; time <= endTime; time += intervalMicros) {
+        checkpoints.push_back(time);
+    }
+    return checkpoints;
+}
+
 // Given startTime and endTime in HH:MM:SS format, return a list of timestamps (also in HH:MM:SS)
 // starting from startTime and no later than endTime with each timestamp being
 // intervalSeconds later than the previous one (ascending).
@@ -53,31 +279,77 @@ std::optional<std::string> getNextNthEntry(const std::string& input, const std::
 //      <intervalSeconds> is the number seconds from current check point to the next
 std::vector<std::string> genCheckPoints(const std::string& startTime, const std::string& endTime, int intervalSeconds) {
     std::vector<std::string> checkpoints;
+    std::optional<TimeOfDay> start = parseTimeOfDay(startTime);
+    std::optional<TimeOfDay> end = parseTimeOfDay(endTime);
+    if (!start.has_value() || !end.has_value())
+        return checkpoints;
+    for (TimeOfDay time : genCheckPoints(start.value(), end.value(), intervalSeconds * MICROS_PER_SECOND)) {
+        checkpoints.push_back(formatTimeOfDay(time));
+    }
+    return checkpoints;
+}
 
-    // Parse start time
-    int startHour, startMinute, startSecond;
-    sscanf(startTime.c_str(), "%d:%d:%d", &startHour, &startMinute, &startSecond);
-
-    // Parse end time
-    int endHour, endMinute, endSecond;
-    sscanf(endTime.c_str(), "%d:%d:%d", &endHour, &endMinute, &endSecond);
-
-    // Convert start time to total seconds
-    int totalSecondsStart = startHour * 3600 + startMinute * 60 + startSecond;
-
-    // Convert end time to total seconds
-    int totalSecondsEnd = endHour * 3600 + endMinute * 60 + endSecond;
+// Exact percentiles of <values> by selection instead of sorting: each percentile
+// costs one nth_element over the part of <values> not yet partitioned, O(n) on
+// average. Between closest ranks the result is interpolated linearly, so the 50th
+// percentile of an even number of values is the mean of the two middle ones.
+//
+// For example, computePercentiles({4, 1, 3, 2}, {50, 100}) returns {2.5, 4}
+//
+// Arguments:
+//      <values> are the samples, reordered by the call
+//      <percentiles> are the percentiles wanted, each in [0, 100], in any order
+//
+// Returns one value per entry of <percentiles> (in the same order), all 0 if <values> is empty
+template <typename T>
+std::vector<double> computePercentiles(std::vector<T>& values, const std::vector<double>& percentiles) {
+    std::vector<double> result(percentiles.size(), 0.0);
+    if (values.empty())
+        return result;
 
-    // Generate checkpoints
-    for (int totalSeconds = totalSecondsStart; totalSeconds <= totalSecondsEnd; totalSeconds += intervalSeconds) {
-        int hour = totalSeconds / 3600;
-        int minute = (totalSeconds % 3600) / 60;
-        int second = totalSeconds % 60;
+    // select in ascending rank order so every nth_element only works on what is left to its right
+    std::vector<size_t> order(percentiles.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&percentiles](size_t a, size_t b) { return percentiles[a] < percentiles[b]; });
 
-        char buffer[9];
-        sprintf(buffer, "%02d:%02d:%02d", hour, minute, second);
-        checkpoints.push_back(buffer);
+    auto first = values.begin();
+    for (size_t i : order) {
+        double p = std::clamp(percentiles[i], 0.0, 100.0);
+        double rank = p / 100.0 * (values.size() - 1);
+        size_t lo = static_cast<size_t>(rank);
+        double fraction = rank - lo;
+        auto nth = values.begin() + lo;
+        std::nth_element(first, nth, values.end());
+        first = nth;
+        double value = *nth;
+        if (fraction > 0.0) {
+            double next = *std::min_element(nth + 1, values.end()); // the value at rank lo + 1
+            value += fraction * (next - value);
+        }
+        result[i] = value;
     }
+    return result;
+}
 
-    return checkpoints;
-}    
+// Parse a comma-separated list of percentiles, e.g. "50,90,99,99.9"
+//
+// Returns nullopt if any entry is not a number in [0, 100]
+std::optional<std::vector<double>> parsePercentiles(const std::string& text) {
+    std::vector<double> percentiles;
+    size_t pos = 0;
+    while (pos <= text.size()) {
+        size_t end = text.find(',', pos);
+        if (end == std::string::npos)
+            end = text.size();
+        std::string item = text.substr(pos, end - pos);
+        char* parsed = nullptr;
+        double p = std::strtod(item.c_str(), &parsed);
+        if (item.empty() || *parsed != '\0' || !(p >= 0.0 && p <= 100.0))
+            return std::nullopt;
+        percentiles.push_back(p);
+        pos = end + 1;
+    }
+    return percentiles;
+}
@@ -0,0 +1,447 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <utility>
+#include <cstdint>
+
+#include <sqlite3.h>
+
+// Interval the rows stored before the interval was recorded (see addIntervalToKey())
+// are kept at in the sorted and percentiles tables. The interval they were sampled
+// at is unknown, and calc never samples every 0 seconds.
+const double LEGACY_INTERVAL_SECONDS = 0;
+
+// Name of the table holding every metric of the rows of <tb_name> in value order, e.g. "ibfs_sorted"
+std::string sortedTable(const std::string& tb_name) {
+    return tb_name + "_sorted";
+}
+
+// Name of the table holding the percentiles of every metric of <tb_name> over all days, e.g. "ibfs_percentiles"
+std::string percentilesTable(const std::string& tb_name) {
+    return tb_name + "_percentiles";
+}
+
+// SQL to create the sorted table of <tb_name> if not already existent: one row per
+// metric (a column of <tb_name>, e.g. "maxAmount") of a day and interval, kept in
+// value order by its key. The date index finds the values a rerun of a day replaces.
+std::string createSortedTableSQL(const std::string& tb_name) {
+    return "CREATE TABLE IF NOT EXISTS " + sortedTable(tb_name) + R"(
+           (intervalSeconds REAL,
+            metric TEXT,
+            value REAL,
+            date INT,
+            PRIMARY KEY (intervalSeconds, metric, value, date)) WITHOUT ROWID;
+    CREATE INDEX IF NOT EXISTS )" + sortedTable(tb_name) + "_date ON " + sortedTable(tb_name) + " (intervalSeconds, date)";
+}
+
+// SQL to create the percentiles table of <tb_name> if not already existent, one row
+// per metric, interval and percentile over all days. <value> is the percentile,
+// interpolated as computePercentiles() does; rankValue and rankDate locate the
+// value at its lower rank in the sorted table, count is the number of days.
+//
+// The calcMedian_*.sql scripts read their medians from here rather than sorting
+// the whole LogStats table. Days stored by a calc that did not record the
+// interval are at LEGACY_INTERVAL_SECONDS, their median only.
+//
+// For example, the median of the daily maxAmount sampled every 30 seconds:
+//      SELECT value FROM ibfs_percentiles WHERE metric = 'maxAmount' AND intervalSeconds = 30 AND percentile = 50
+std::string createPercentilesTableSQL(const std::string& tb_name) {
+    return "CREATE TABLE IF NOT EXISTS " + percentilesTable(tb_name) + R"(
+           (intervalSeconds REAL,
+            metric TEXT,
+            percentile REAL,
+            count INT,
+            rankValue REAL,
+            rankDate INT,
+            value REAL,
+            PRIMARY KEY (intervalSeconds, metric, percentile))
+    )";
+}
+
+// Percentiles of every metric of a LogStats table over all days, maintained as
+// rows are stored instead of sorting the whole table on every query.
+//
+// Every metric value also goes into the sortedTable(), an index ordered by
+// (value, date). Each tracked percentile of a metric keeps the (value, date) at
+// its rank; storing or replacing a day moves it by at most one position, a
+// single index seek, so a row costs O(log n) per metric and percentile and
+// reading a percentile is a lookup in the percentilesTable(). The percentiles
+// are written out by flush(), within the transaction of the rows.
+//
+// Percentiles are tracked from the first row that asks for them, and the first
+// time they are asked for one is located with an index scan of its rank. Tables
+// stored before the sorted table existed are copied into it when it is created.
+// Rows stored before the interval was recorded go in at LEGACY_INTERVAL_SECONDS,
+// with their median tracked, by the first open() that finds them.
+//
+// Every call returns false on an SQLite error, sqlite3_errmsg() tells which.
+//
+// For example:
+//      CrossDayPercentiles percentiles(db, "ibfs");
+//      percentiles.open(columns);
+//      percentiles.update(30, 20240520, {{"maxAmount", 1.5e6}, {"meanAmount", 4.2e5}}, {50, 99});
+//      percentiles.flush();
+class CrossDayPercentiles {
+public:
+    CrossDayPercentiles(sqlite3* db, std::string tb_name) : db_(db), table_(std::move(tb_name)) {}
+
+    ~CrossDayPercentiles() {
+        for (auto& entry : statements_) {
+            sqlite3_finalize(entry.second);
+        }
+    }
+
+    CrossDayPercentiles(const CrossDayPercentiles&) = delete;
+    CrossDayPercentiles& operator=(const CrossDayPercentiles&) = delete;
+
+    // creates the sorted and percentiles tables of the LogStats table, copying the
+    // <metricColumns> of its rows into a sorted table that did not exist yet, and
+    // those of the rows without an interval once
+    bool open(const std::vector<std::string>& metricColumns) {
+        sqlite3_stmt* exists = statement("SELECT 1 FROM sqlite_master WHERE type = 'table' AND name = ?");
+        if (!exists)
+            return false;
+        sqlite3_bind_text(exists, 1, sortedTable(table_).c_str(), -1, SQLITE_TRANSIENT);
+        int rc = sqlite3_step(exists);
+        sqlite3_reset(exists);
+        if (rc != SQLITE_ROW && rc != SQLITE_DONE)
+            return false;
+        if (!exec(createSortedTableSQL(table_)) || !exec(createPercentilesTableSQL(table_)))
+            return false;
+        for (size_t i = 0; rc == SQLITE_DONE && i < metricColumns.size(); ++i) {
+            const std::string& column = metricColumns[i];
+            if (!exec("INSERT INTO " + sortedTable(table_) + " (intervalSeconds, metric, value, date) SELECT intervalSeconds, '" +
+                    column + "', " + column + ", date FROM " + table_ + " WHERE intervalSeconds IS NOT NULL AND " + column + " IS NOT NULL"))
+                return false;
+        }
+        return addLegacyRows(metricColumns);
+    }
+
+    // stores the metrics of the day <date> sampled every <intervalSeconds>,
+    // replacing those stored for it before, and moves the percentiles along
+    //
+    // Arguments:
+    //      <values> are the <metric, value> pairs of the day, metrics are column names
+    //      <percentiles> to track for every metric of the interval, e.g. {50, 90, 99, 99.9}
+    bool update(double intervalSeconds, int date, const std::vector<std::pair<std::string, double>>& values,
+        const std::vector<double>& percentiles) {
+        std::map<std::string, double> previous;
+        sqlite3_stmt* day = statement("SELECT metric, value FROM " + sortedTable(table_) + " WHERE intervalSeconds = ? AND date = ?");
+        if (!day)
+            return false;
+        sqlite3_bind_double(day, 1, intervalSeconds);
+        sqlite3_bind_int(day, 2, date);
+        int rc;
+        while ((rc = sqlite3_step(day)) == SQLITE_ROW) {
+            previous[reinterpret_cast<const char*>(sqlite3_column_text(day, 0))] = sqlite3_column_double(day, 1);
+        }
+        sqlite3_reset(day);
+        if (rc != SQLITE_DONE)
+            return false;
+
+        std::set<std::string> stored;
+        for (const auto& entry : values) {
+            const std::string& metric = entry.first;
+            Key value{entry.second, date};
+            stored.insert(metric);
+            std::vector<Tracker>* trackers = load(intervalSeconds, metric);
+            if (!trackers)
+                return false;
+            auto old = previous.find(metric);
+            if (old == previous.end() || old->second != value.value) {
+                if (old != previous.end() && !erase(*trackers, intervalSeconds, metric, Key{old->second, date}))
+                    return false;
+                if (!insert(*trackers, intervalSeconds, metric, value))
+                    return false;
+            }
+            if (!track(*trackers, intervalSeconds, metric, percentiles))
+                return false;
+        }
+        // metrics the day had before but not any more, e.g. percentiles no longer asked for
+        for (const auto& old : previous) {
+            if (stored.count(old.first) > 0)
+                continue;
+            std::vector<Tracker>* trackers = load(intervalSeconds, old.first);
+            if (!trackers || !erase(*trackers, intervalSeconds, old.first, Key{old.second, date}))
+                return false;
+        }
+        return true;
+    }
+
+    // writes the percentiles moved since the last flush() to the percentilesTable()
+    bool flush() {
+        sqlite3_stmt* save = statement("INSERT OR REPLACE INTO " + percentilesTable(table_) +
+            " (intervalSeconds, metric, percentile, count, rankValue, rankDate, value) VALUES (?, ?, ?, ?, ?, ?, ?)");
+        sqlite3_stmt* remove = statement("DELETE FROM " + percentilesTable(table_) + " WHERE intervalSeconds = ? AND metric = ? AND percentile = ?");
+        if (!save || !remove)
+            return false;
+        for (const auto& entry : trackers_) {
+            double intervalSeconds = entry.first.first;
+            const std::string& metric = entry.first.second;
+            for (const Tracker& tracker : entry.second) {
+                if (!tracker.moved)
+                    continue;
+                sqlite3_stmt* stmt = tracker.count == 0 ? remove : save;
+                int cnt = 1;
+                sqlite3_bind_double(stmt, cnt++, intervalSeconds);
+                sqlite3_bind_text(stmt, cnt++, metric.c_str(), -1, SQLITE_TRANSIENT);
+                sqlite3_bind_double(stmt, cnt++, tracker.percentile);
+                if (tracker.count > 0) {
+                    double value = tracker.at.value;
+                    double rank = tracker.percentile / 100.0 * (tracker.count - 1);
+                    double fraction = rank - rankOf(tracker.percentile, tracker.count);
+                    if (fraction > 0.0) {
+                        Key next;
+                        if (!step(intervalSeconds, metric, tracker.at, 1, next))
+                            return false;
+                        value += fraction * (next.value - value);
+                    }
+                    sqlite3_bind_int64(stmt, cnt++, tracker.count);
+                    sqlite3_bind_double(stmt, cnt++, tracker.at.value);
+                    sqlite3_bind_int(stmt, cnt++, tracker.at.date);
+                    sqlite3_bind_double(stmt, cnt++, value);
+                }
+                int rc = sqlite3_step(stmt);
+                sqlite3_reset(stmt);
+                if (rc != SQLITE_DONE)
+                    return false;
+            }
+        }
+        trackers_.clear();
+        return true;
+    }
+
+    // remembers the percentiles as they are, for undo() to go back to when the
+    // row being stored is rolled back to a savepoint
+    void save() { saved_ = trackers_; }
+    void undo() { trackers_ = saved_; }
+
+private:
+    // position in the sorted table of a metric, ordered by value then date
+    struct Key {
+        double value = 0;
+        int date = 0;
+        bool operator<(const Key& other) const { return value < other.value || (value == other.value && date < other.date); }
+        bool operator==(const Key& other) const { return value == other.value && date == other.date; }
+    };
+
+    struct Tracker {
+        double percentile;
+        int64_t count;   // values of the metric
+        Key at;          // the value at rankOf(percentile, count)
+        bool moved;      // since loaded
+    };
+
+    sqlite3* db_;
+    std::string table_;
+    std::map<std::string, sqlite3_stmt*> statements_;                        // <sql, prepared statement>
+    std::map<std::pair<double, std::string>, std::vector<Tracker>> trackers_; // <interval and metric, its percentiles>
+    std::map<std::pair<double, std::string>, std::vector<Tracker>> saved_;    // trackers_ as of save()
+
+    // the lower of the ranks a percentile falls between, as in computePercentiles()
+    static int64_t rankOf(double percentile, int64_t count) {
+        return static_cast<int64_t>(percentile / 100.0 * (count - 1));
+    }
+
+    bool exec(const std::string& sql) {
+        return sqlite3_exec(db_, sql.c_str(), nullptr, nullptr, nullptr) == SQLITE_OK;
+    }
+
+    sqlite3_stmt* statement(const std::string& sql) {
+        auto it = statements_.find(sql);
+        if (it != statements_.end())
+            return it->second;
+        sqlite3_stmt* stmt = nullptr;
+        if (sqlite3_prepare_v2(db_, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK)
+            return nullptr;
+        statements_.emplace(sql, stmt);
+        return stmt;
+    }
+
+    // copies the <metricColumns> of the rows without an interval into the sorted table
+    // at LEGACY_INTERVAL_SECONDS and tracks their median, unless done before: no such
+    // row is stored any more, so a sorted table with any of them has them all
+    bool addLegacyRows(const std::vector<std::string>& metricColumns) {
+        sqlite3_stmt* pending = statement("SELECT EXISTS (SELECT 1 FROM " + table_ + " WHERE intervalSeconds IS NULL) AND NOT EXISTS (SELECT 1 FROM " +
+            sortedTable(table_) + " WHERE intervalSeconds = ?)");
+        if (!pending)
+            return false;
+        sqlite3_bind_double(pending, 1, LEGACY_INTERVAL_SECONDS);
+        int rc = sqlite3_step(pending);
+        bool add = rc == SQLITE_ROW && sqlite3_column_int(pending, 0) != 0;
+        sqlite3_reset(pending);
+        if (rc != SQLITE_ROW)
+            return false;
+        for (size_t i = 0; add && i < metricColumns.size(); ++i) {
+            const std::string& column = metricColumns[i];
+            sqlite3_stmt* copy = statement("INSERT OR IGNORE INTO " + sortedTable(table_) + " (intervalSeconds, metric, value, date) SELECT ?, '" +
+                column + "', " + column + ", date FROM " + table_ + " WHERE intervalSeconds IS NULL AND " + column + " IS NOT NULL");
+            if (!copy)
+                return false;
+            sqlite3_bind_double(copy, 1, LEGACY_INTERVAL_SECONDS);
+            rc = sqlite3_step(copy);
+            sqlite3_reset(copy);
+            if (rc != SQLITE_DONE)
+                return false;
+            if (sqlite3_changes(db_) == 0)
+                continue; // no day has a value of the metric, e.g. a percentile column added later
+            std::vector<Tracker>* trackers = load(LEGACY_INTERVAL_SECONDS, column);
+            if (!trackers || !track(*trackers, LEGACY_INTERVAL_SECONDS, column, {50}))
+                return false;
+        }
+        return true;
+    }
+
+    // the percentiles tracked for <metric>, read from the percentilesTable() on first use since the last flush()
+    std::vector<Tracker>* load(double intervalSeconds, const std::string& metric) {
+        auto key = std::make_pair(intervalSeconds, metric);
+        auto it = trackers_.find(key);
+        if (it != trackers_.end())
+            return &it->second;
+        sqlite3_stmt* stmt = statement("SELECT percentile, count, rankValue, rankDate FROM " + percentilesTable(table_) +
+            " WHERE intervalSeconds = ? AND metric = ?");
+        if (!stmt)
+            return nullptr;
+        sqlite3_bind_double(stmt, 1, intervalSeconds);
+        sqlite3_bind_text(stmt, 2, metric.c_str(), -1, SQLITE_TRANSIENT);
+        std::vector<Tracker> trackers;
+        int rc;
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+            trackers.push_back(Tracker{sqlite3_column_double(stmt, 0), sqlite3_column_int64(stmt, 1),
+                Key{sqlite3_column_double(stmt, 2), sqlite3_column_int(stmt, 3)}, false});
+        }
+        sqlite3_reset(stmt);
+        if (rc != SQLITE_DONE)
+            return nullptr;
+        return &trackers_.emplace(key, std::move(trackers)).first->second;
+    }
+
+    // moves <from> <steps> (1 or -1) positions through the sorted values of <metric> into <to>
+    bool step(double intervalSeconds, const std::string& metric, const Key& from, int steps, Key& to) {
+        sqlite3_stmt* stmt = statement(steps > 0 ?
+            "SELECT value, date FROM " + sortedTable(table_) + " WHERE intervalSeconds = ? AND metric = ? AND (value, date) > (?, ?) ORDER BY value, date LIMIT 1" :
+            "SELECT value, date FROM " + sortedTable(table_) + " WHERE intervalSeconds = ? AND metric = ? AND (value, date) < (?, ?) ORDER BY value DESC, date DESC LIMIT 1");
+        if (!stmt)
+            return false;
+        sqlite3_bind_double(stmt, 1, intervalSeconds);
+        sqlite3_bind_text(stmt, 2, metric.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_double(stmt, 3, from.value);
+        sqlite3_bind_int(stmt, 4, from.date);
+        int rc = sqlite3_step(stmt);
+        if (rc == SQLITE_ROW)
+            to = Key{sqlite3_column_double(stmt, 0), sqlite3_column_int(stmt, 1)};
+        sqlite3_reset(stmt);
+        return rc == SQLITE_ROW;
+    }
+
+    // moves <tracker>, now at <rank>, to the rank of its percentile
+    bool settle(Tracker& tracker, double intervalSeconds, const std::string& metric, int64_t rank) {
+        tracker.moved = true;
+        for (int64_t target = rankOf(tracker.percentile, tracker.count); rank != target; rank += rank < target ? 1 : -1) {
+            if (!step(intervalSeconds, metric, tracker.at, rank < target ? 1 : -1, tracker.at))
+                return false;
+        }
+        return true;
+    }
+
+    bool insert(std::vector<Tracker>& trackers, double intervalSeconds, const std::string& metric, const Key& value) {
+        sqlite3_stmt* stmt = statement("INSERT INTO " + sortedTable(table_) + " (intervalSeconds, metric, value, date) VALUES (?, ?, ?, ?)");
+        if (!stmt)
+            return false;
+        sqlite3_bind_double(stmt, 1, intervalSeconds);
+        sqlite3_bind_text(stmt, 2, metric.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_double(stmt, 3, value.value);
+        sqlite3_bind_int(stmt, 4, value.date);
+        int rc = sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+        if (rc != SQLITE_DONE)
+            return false;
+        for (Tracker& tracker : trackers) {
+            if (tracker.count == 0) {
+                tracker = Tracker{tracker.percentile, 1, value, true};
+                continue;
+            }
+            int64_t rank = rankOf(tracker.percentile, tracker.count) + (value < tracker.at ? 1 : 0);
+            ++tracker.count;
+            if (!settle(tracker, intervalSeconds, metric, rank))
+                return false;
+        }
+        return true;
+    }
+
+    bool erase(std::vector<Tracker>& trackers, double intervalSeconds, const std::string& metric, const Key& value) {
+        sqlite3_stmt* stmt = statement("DELETE FROM " + sortedTable(table_) + " WHERE intervalSeconds = ? AND metric = ? AND value = ? AND date = ?");
+        if (!stmt)
+            return false;
+        sqlite3_bind_double(stmt, 1, intervalSeconds);
+        sqlite3_bind_text(stmt, 2, metric.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_double(stmt, 3, value.value);
+        sqlite3_bind_int(stmt, 4, value.date);
+        int rc = sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+        if (rc != SQLITE_DONE)
+            return false;
+        for (Tracker& tracker : trackers) {
+            if (tracker.count <= 1) {
+                tracker.count = 0;
+                tracker.moved = true;
+                continue;
+            }
+            int64_t rank = rankOf(tracker.percentile, tracker.count);
+            if (value < tracker.at) {
+                --rank;
+            } else if (value == tracker.at) {
+                // the value it was at is gone, the next one takes its rank or else the previous one is one below
+                Key at = tracker.at;
+                if (!step(intervalSeconds, metric, at, 1, tracker.at)) {
+                    if (!step(intervalSeconds, metric, at, -1, tracker.at))
+                        return false;
+                    --rank;
+                }
+            }
+            --tracker.count;
+            if (!settle(tracker, intervalSeconds, metric, rank))
+                return false;
+        }
+        return true;
+    }
+
+    // starts tracking the <percentiles> of <metric> not tracked yet, from the values stored so far
+    bool track(std::vector<Tracker>& trackers, double intervalSeconds, const std::string& metric, const std::vector<double>& percentiles) {
+        for (double percentile : percentiles) {
+            bool tracked = false;
+            for (const Tracker& tracker : trackers) {
+                tracked = tracked || tracker.percentile == percentile;
+            }
+            if (tracked)
+                continue;
+            sqlite3_stmt* count = statement("SELECT COUNT(*) FROM " + sortedTable(table_) + " WHERE intervalSeconds = ? AND metric = ?");
+            sqlite3_stmt* nth = statement("SELECT value, date FROM " + sortedTable(table_) +
+                " WHERE intervalSeconds = ? AND metric = ? ORDER BY value, date LIMIT 1 OFFSET ?");
+            if (!count || !nth)
+                return false;
+            sqlite3_bind_double(count, 1, intervalSeconds);
+            sqlite3_bind_text(count, 2, metric.c_str(), -1, SQLITE_TRANSIENT);
+            int rc = sqlite3_step(count);
+            int64_t values = rc == SQLITE_ROW ? sqlite3_column_int64(count, 0) : 0;
+            sqlite3_reset(count);
+            if (rc != SQLITE_ROW)
+                return false;
+            Tracker tracker{percentile, values, Key{}, true};
+            sqlite3_bind_double(nth, 1, intervalSeconds);
+            sqlite3_bind_text(nth, 2, metric.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_int64(nth, 3, rankOf(percentile, values));
+            rc = sqlite3_step(nth);
+            if (rc == SQLITE_ROW)
+                tracker.at = Key{sqlite3_column_double(nth, 0), sqlite3_column_int(nth, 1)};
+            sqlite3_reset(nth);
+            if (rc != SQLITE_ROW)
+                return false;
+            trackers.push_back(tracker);
+        }
+        return true;
+    }
+};
@@ -0,0 +1,193 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include "gzip_log.h"
+#include "log_reader.h"
+#include "order_replay.h"
+
+// On-disk cache of the OrderEvents of one log, so the same day can be
+// re-sampled (e.g. at another interval) by scanning a few compact arrays
+// instead of parsing the text log again. The file is memory-mapped and read in
+// place, one array (column) per OrderEvent member.
+//
+// Layout, in host byte order with every column 8-byte aligned:
+//      EventCacheHeader
+//      strategies char[strategiesSize]  padded to a multiple of 8 bytes
+//      symbols  char[symbolsSize]  the names of the symbols, in index order and each ended by '\n', padded likewise
+//      time     int64_t[count]     microseconds since midnight
+//      orderId  uint64_t[count]    packed, see packOrderId()
+//      price    int64_t[count]     ticks
+//      shares   int32_t[count]
+//      symbol   uint32_t[count]    see OrderEvent::symbol, together with shares a multiple of 8 bytes
+//      status   char[count]        'O', 'C', 'M' or OrderEvent::CLOCK_ONLY
+//      strategy uint8_t[count]     see OrderEvent::strategy
+struct EventCacheHeader {
+    char magic[8];           // EVENT_CACHE_MAGIC
+    uint64_t count;          // number of events
+    uint64_t strategiesSize; // length of the strategy filter (-p) the log was read with, e.g. "C70,C71", empty if none
+    uint64_t symbolsSize;    // length of the symbol names
+};
+
+const char EVENT_CACHE_MAGIC[8] = {'C', 'A', 'L', 'C', 'E', 'V', 'C', '3'};
+
+// Returns true if <path> names an event cache, e.g. 20240520.ibfs.evc
+bool isEventCachePath(std::string_view path) {
+    return path.size() > 4 && path.substr(path.size() - 4) == ".evc";
+}
+
+// <path> without a trailing ".evc", so 20240520.ibfs.evc is dated and typed like 20240520.ibfs
+std::string stripEventCacheSuffix(const std::string& path) {
+    return isEventCachePath(path) ? path.substr(0, path.size() - 4) : path;
+}
+
+// Where the events of a log are cached, e.g. 20240520.ibfs.gz -> 20240520.ibfs.evc
+std::string eventCachePath(const std::string& logPath) {
+    return stripGzipSuffix(logPath) + ".evc";
+}
+
+// Collects the events of a log column by column and writes them out as an event cache
+class EventCacheWriter {
+public:
+    void append(const OrderEvent& event) {
+        times_.push_back(event.time);
+        orderIds_.push_back(event.orderId);
+        prices_.push_back(event.price);
+        shares_.push_back(event.shares);
+        symbols_.push_back(event.symbol);
+        statuses_.push_back(event.status);
+        strategies_.push_back(event.strategy);
+    }
+
+    size_t size() const { return times_.size(); }
+
+    // Writes the cache to a temporary file next to <path> and renames it into
+    // place, so readers never see a partial cache. <symbolNames> are the names
+    // of the symbol indexes of the events. Returns false on error.
+    bool write(const std::string& path, const std::string& strategies, const std::vector<std::string>& symbolNames = {}) const {
+        std::string symbols;
+        for (const auto& name : symbolNames) {
+            symbols += name + '\n';
+        }
+        EventCacheHeader header{};
+        std::memcpy(header.magic, EVENT_CACHE_MAGIC, sizeof(header.magic));
+        header.count = times_.size();
+        header.strategiesSize = strategies.size();
+        header.symbolsSize = symbols.size();
+
+        std::string tmpPath = path + ".tmp";
+        FILE* out = std::fopen(tmpPath.c_str(), "wb");
+        if (!out)
+            return false;
+        const char padding[8] = {};
+        size_t strategiesPadding = (8 - strategies.size() % 8) % 8;
+        size_t symbolsPadding = (8 - symbols.size() % 8) % 8;
+        bool ok = std::fwrite(&header, sizeof(header), 1, out) == 1 &&
+            std::fwrite(strategies.data(), 1, strategies.size(), out) == strategies.size() &&
+            std::fwrite(padding, 1, strategiesPadding, out) == strategiesPadding &&
+            std::fwrite(symbols.data(), 1, symbols.size(), out) == symbols.size() &&
+            std::fwrite(padding, 1, symbolsPadding, out) == symbolsPadding &&
+            writeColumn(out, times_) && writeColumn(out, orderIds_) && writeColumn(out, prices_) &&
+            writeColumn(out, shares_) && writeColumn(out, symbols_) && writeColumn(out, statuses_) && writeColumn(out, strategies_);
+        ok = std::fclose(out) == 0 && ok;
+        if (ok && std::rename(tmpPath.c_str(), path.c_str()) == 0)
+            return true;
+        std::remove(tmpPath.c_str());
+        return false;
+    }
+
+private:
+    std::vector<int64_t> times_;
+    std::vector<uint64_t> orderIds_;
+    std::vector<int64_t> prices_;
+    std::vector<int32_t> shares_;
+    std::vector<uint32_t> symbols_;
+    std::vector<char> statuses_;
+    std::vector<uint8_t> strategies_;
+
+    template <typename T>
+    static bool writeColumn(FILE* out, const std::vector<T>& column) {
+        return column.empty() || std::fwrite(column.data(), sizeof(T), column.size(), out) == column.size();
+    }
+};
+
+// Read-only, memory-mapped event cache. isOpen() is false if the file is
+// missing, not an event cache or does not have the size its header implies.
+//
+// For example:
+//      EventCache cache("20240520.ibfs.evc");
+//      for (size_t i = 0; cache.isOpen() && i < cache.size(); ++i) {
+//          OrderEvent event = cache.event(i);
+//      }
+class EventCache {
+public:
+    explicit EventCache(const std::string& path) : file_(path) {
+        if (!file_.isOpen() || file_.size() < sizeof(EventCacheHeader))
+            return;
+        const char* base = file_.data();
+        std::memcpy(&header_, base, sizeof(header_));
+        if (std::memcmp(header_.magic, EVENT_CACHE_MAGIC, sizeof(header_.magic)) != 0)
+            return;
+        size_t n = header_.count;
+        // one byte per event and per name at least, also rules out overflow below
+        if (n > file_.size() || header_.strategiesSize > file_.size() || header_.symbolsSize > file_.size())
+            return;
+        size_t strategiesBytes = (header_.strategiesSize + 7) / 8 * 8;
+        size_t symbolsBytes = (header_.symbolsSize + 7) / 8 * 8;
+        size_t expected = sizeof(EventCacheHeader) + strategiesBytes + symbolsBytes +
+            n * (sizeof(int64_t) + sizeof(uint64_t) + sizeof(int64_t) + sizeof(int32_t) + sizeof(uint32_t) + 2);
+        if (file_.size() != expected)
+            return;
+        const char* names = base + sizeof(EventCacheHeader);
+        strategies_ = std::string_view(names, header_.strategiesSize);
+        std::string_view symbols(names + strategiesBytes, header_.symbolsSize);
+        for (size_t pos = 0, end; (end = symbols.find('\n', pos)) != std::string_view::npos; pos = end + 1) {
+            symbolNames_.emplace_back(symbols.substr(pos, end - pos));
+        }
+        const char* column = names + strategiesBytes + symbolsBytes;
+        times_ = reinterpret_cast<const int64_t*>(column);
+        orderIds_ = reinterpret_cast<const uint64_t*>(column += n * sizeof(int64_t));
+        prices_ = reinterpret_cast<const int64_t*>(column += n * sizeof(uint64_t));
+        shares_ = reinterpret_cast<const int32_t*>(column += n * sizeof(int64_t));
+        symbols_ = reinterpret_cast<const uint32_t*>(column += n * sizeof(int32_t));
+        statuses_ = column + n * sizeof(uint32_t);
+        strategyIndexes_ = reinterpret_cast<const uint8_t*>(statuses_ + n);
+        valid_ = true;
+    }
+
+    bool isOpen() const { return valid_; }
+    size_t size() const { return valid_ ? header_.count : 0; }
+    std::string_view strategies() const { return strategies_; } // see EventCacheHeader::strategiesSize
+    const std::vector<std::string>& symbolNames() const { return symbolNames_; } // indexed by OrderEvent::symbol
+
+    OrderEvent event(size_t i) const {
+        OrderEvent event;
+        event.time = times_[i];
+        event.orderId = orderIds_[i];
+        event.price = prices_[i];
+        event.shares = shares_[i];
+        event.symbol = symbols_[i] < symbolNames_.size() ? symbols_[i] : SymbolTable::NO_SYMBOL;
+        event.status = statuses_[i];
+        event.strategy = strategyIndexes_[i];
+        return event;
+    }
+
+private:
+    MappedLog file_;
+    EventCacheHeader header_{};
+    bool valid_ = false;
+    const int64_t* times_ = nullptr;
+    const uint64_t* orderIds_ = nullptr;
+    const int64_t* prices_ = nullptr;
+    const int32_t* shares_ = nullptr;
+    const uint32_t* symbols_ = nullptr;
+    const char* statuses_ = nullptr;
+    const uint8_t* strategyIndexes_ = nullptr;
+    std::string_view strategies_;
+    std::vector<std::string> symbolNames_;
+};
@@ -0,0 +1,180 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <array>
+#include <string_view>
+#include <vector>
+#include <optional>
+#include <cstdint>
+
+#include "calc.h"
+#include "log_filter.h"
+#include "order_replay.h"
+#include "order_table.h"
+#include "symbol_table.h"
+#include "ticks.h"
+#include "warning_log.h"
+
+// What EventParser has read so far
+struct ParseCounters {
+    uint64_t lines = 0;    // entries read
+    uint64_t bytes = 0;    // of the entries read, line ends included
+    uint64_t skipped = 0;  // too short to be an order entry (80 characters or less)
+    uint64_t filtered = 0; // dropped by the LogFilter
+    uint64_t events = 0;   // order updates, CLOCK_ONLY events not included
+    std::array<uint64_t, Warning::Count> warnings{}; // per Warning kind
+
+    void merge(const ParseCounters& other) {
+        lines += other.lines;
+        bytes += other.bytes;
+        skipped += other.skipped;
+        filtered += other.filtered;
+        events += other.events;
+        for (size_t i = 0; i < warnings.size(); ++i) {
+            warnings[i] += other.warnings[i];
+        }
+    }
+};
+
+// Reduces a log entry to an OrderEvent. Returns false if the entry has no
+// valid timestamp and is skipped altogether; an entry without a usable order
+// update is reported to <warnings>, counted in <counters> (if not nullptr) and
+// comes back as an OrderEvent::CLOCK_ONLY event.
+bool parseOrderEvent(std::string_view line, LogFields& fields, const std::string& filename, OrderEvent& event,
+    WarningSink& warnings = coutWarnings(), ParseCounters* counters = nullptr)
+{
+    if (line.length() <= 80)
+        return false;
+    auto warn = [&](size_t kind, std::string_view field = std::string_view()) {
+        if (counters)
+            ++counters->warnings[kind];
+        warnings.warn(kind, filename, line, field);
+    };
+    event = OrderEvent();
+    bool hasPriceAndQty = tokenizeLine(line, fields);
+    std::optional<TimeOfDay> now = parseTimeOfDay(fields[Field::Timestamp]);
+    if (!now.has_value()) {
+        warn(Warning::BadTimestamp);
+        return false;
+    }
+    event.time = now.value();
+
+    char status;
+    if (fields[Field::Tag].find("MatchReport") != std::string_view::npos) {
+        status = 'M';
+    } else {
+        size_t statusPos = fields[Field::Status].find('=');
+        if (statusPos == std::string_view::npos || statusPos + 1 == fields[Field::Status].size())
+        {
+            warn(Warning::NoStatus);
+            return true;
+        }
+        status = fields[Field::Status][statusPos+1];
+    }
+    switch (status)
+    {
+        case 'O': // new order
+        case 'C': // cancel order
+        case 'M': // match report
+        {
+            if (fields[Field::Side] != "Buy" || fields[Field::Price].empty()) {
+                warn(Warning::NoPrice);
+                return true;
+            }
+            std::optional<Ticks> price = parsePriceTicks(fields[Field::Price]);
+            if (!price.has_value()) {
+                warn(Warning::MalformedPrice, fields[Field::Price]);
+                return true;
+            }
+            if (!hasPriceAndQty) {
+                warn(Warning::NoShares);
+                return true;
+            }
+            std::optional<int> shares = parseUnsigned<int>(fields[Field::Qty]);
+            if (!shares.has_value()) {
+                warn(Warning::MalformedShares, fields[Field::Qty]);
+                return true;
+            }
+            event.orderId = packOrderId(line.substr(76, 5));
+            event.price = price.value();
+            event.shares = shares.value();
+            event.status = status;
+            return true;
+        }
+        default:
+            warn(Warning::UnknownStatus);
+            return true;
+    }
+}
+
+// The per-entry half of calc: turns log entries into OrderEvents by filtering
+// (optional), parsing (see parseOrderEvent()), routing each order to its
+// strategy and numbering its symbol. The entry is only looked at through views
+// into it, so once the symbols of the log have been seen, reading an entry
+// allocates nothing.
+//
+// For example:
+//      EventParser parser("20240520.ibfs", &filter, false, true);
+//      OrderEvent event;
+//      while (log.nextLine(line)) { if (parser.read(line, event)) replay(event); }
+class EventParser {
+public:
+    // Arguments:
+    //      <filename> names the log in warnings
+    //      <filter> entries have to pass, nullptr to keep every entry
+    //      <partitionByStrategy> routes every order to the index of its strategy
+    //          prefix in <filter> (see OrderEvent::strategy), otherwise all go to 0
+    //      <trackSymbols> numbers the symbol of every order in symbols()
+    EventParser(std::string filename, const LogFilter* filter, bool partitionByStrategy, bool trackSymbols)
+        : filename_(std::move(filename)), filter_(filter), partition_(partitionByStrategy && filter), trackSymbols_(trackSymbols) {}
+
+    // Stores the event of <line> in <event> and returns true, or returns false if
+    // the entry is filtered out or is no event at all. Problems with the entry
+    // are reported to <warnings>.
+    bool read(std::string_view line, OrderEvent& event, WarningSink& warnings = coutWarnings()) {
+        ++counters_.lines;
+        counters_.bytes += line.size() + 1;
+        if (line.size() <= 80) {
+            ++counters_.skipped;
+            return false;
+        }
+        if (filter_ && !filter_->accept(line)) {
+            ++counters_.filtered;
+            return false;
+        }
+        if (!parseOrderEvent(line, fields_, filename_, event, warnings, &counters_))
+            return false;
+        if (event.status != OrderEvent::CLOCK_ONLY) {
+            ++counters_.events;
+            event.strategy = routeStrategy();
+            if (trackSymbols_)
+                event.symbol = symbols_.intern(fields_[Field::Symbol]);
+        }
+        return true;
+    }
+
+    const SymbolTable& symbols() const { return symbols_; }
+    const ParseCounters& counters() const { return counters_; }
+
+private:
+    std::string filename_;
+    const LogFilter* filter_;
+    bool partition_;
+    bool trackSymbols_;
+    LogFields fields_; // views into the entry being read, filled by tokenizeLine
+    SymbolTable symbols_;
+    ParseCounters counters_;
+
+    // index of the strategy prefix the order of the entry in fields_ belongs to
+    uint8_t routeStrategy() const {
+        if (!partition_)
+            return 0;
+        const auto& prefixes = filter_->strategyPrefixes;
+        for (size_t i = 0; i < prefixes.size(); ++i) {
+            if (fields_[Field::Strategy].substr(0, prefixes[i].size()) == prefixes[i])
+                return static_cast<uint8_t>(i);
+        }
+        return OrderEvent::UNROUTED;
+    }
+};
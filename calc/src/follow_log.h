@@ -0,0 +1,123 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <atomic>
+#include <cstring>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+// Log that is still being written, read like `tail -f`: lines are read from
+// the last offset as they are appended, and the reader sleeps on inotify in
+// between, so a new line is handed out as soon as the writer has finished it.
+//
+// nextLine() blocks until a complete line ('\n' terminated) is available. If
+// nothing arrives for POLL_INTERVAL_MS it returns an empty line instead, so the
+// caller gets to act on the passage of time (e.g. a check point going by) even
+// while the log is quiet. It only returns false once <stop> is set, e.g. from a
+// signal handler.
+//
+// Like GzipLog, a line view only stays valid until the next call to nextLine().
+//
+// For example:
+//      FollowLog log("20240520.ibfs", &stopRequested);
+//      std::string_view line;
+//      while (log.isOpen() && log.nextLine(line)) { if (!line.empty()) ... }
+class FollowLog {
+public:
+    static constexpr int POLL_INTERVAL_MS = 100;
+    static constexpr size_t READ_SIZE = 64 * 1024;
+
+    explicit FollowLog(const std::string& path, const std::atomic<bool>* stop = nullptr) : stop_(stop) {
+        fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd_ < 0)
+            return;
+        // without inotify we still follow the file, just by polling it every POLL_INTERVAL_MS
+        notifyFd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (notifyFd_ >= 0 && inotify_add_watch(notifyFd_, path.c_str(), IN_MODIFY) < 0) {
+            ::close(notifyFd_);
+            notifyFd_ = -1;
+        }
+    }
+
+    ~FollowLog() {
+        if (notifyFd_ >= 0)
+            ::close(notifyFd_);
+        if (fd_ >= 0)
+            ::close(fd_);
+    }
+
+    FollowLog(const FollowLog&) = delete;
+    FollowLog& operator=(const FollowLog&) = delete;
+
+    bool isOpen() const { return fd_ >= 0; }
+
+    // Stores the next complete line in <line> (empty if the log has been quiet
+    // for POLL_INTERVAL_MS) and returns true, or returns false once stopped
+    bool nextLine(std::string_view& line) {
+        if (fd_ < 0)
+            return false;
+        bool waited = false;
+        for (;;) {
+            if (takeLine(line))
+                return true;
+            if (readAppended())
+                continue;
+            if (stop_ && stop_->load())
+                return false;
+            if (waited) {
+                line = std::string_view();
+                return true;
+            }
+            waitForData();
+            waited = true;
+        }
+    }
+
+private:
+    int fd_ = -1;
+    int notifyFd_ = -1;
+    const std::atomic<bool>* stop_;
+    std::string buffer_; // read but not yet handed out, buffer_[pos_..] may end in a partial line
+    size_t pos_ = 0;
+
+    bool takeLine(std::string_view& line) {
+        const char* start = buffer_.data() + pos_;
+        const char* eol = static_cast<const char*>(std::memchr(start, '\n', buffer_.size() - pos_));
+        if (!eol)
+            return false;
+        size_t len = static_cast<size_t>(eol - start);
+        line = std::string_view(start, len);
+        pos_ += len + 1;
+        return true;
+    }
+
+    // appends whatever the writer has added since the last read, false if nothing was added
+    bool readAppended() {
+        buffer_.erase(0, pos_); // only the partial line is left, previous views are done with
+        pos_ = 0;
+        size_t have = buffer_.size();
+        buffer_.resize(have + READ_SIZE);
+        ssize_t n = ::read(fd_, &buffer_[have], READ_SIZE);
+        buffer_.resize(have + (n > 0 ? static_cast<size_t>(n) : 0));
+        return n > 0;
+    }
+
+    // sleeps until the file is modified or POLL_INTERVAL_MS has passed
+    void waitForData() {
+        if (notifyFd_ < 0) {
+            poll(nullptr, 0, POLL_INTERVAL_MS);
+            return;
+        }
+        struct pollfd pfd = {notifyFd_, POLLIN, 0};
+        if (poll(&pfd, 1, POLL_INTERVAL_MS) > 0) {
+            char events[4096];
+            while (::read(notifyFd_, events, sizeof(events)) > 0) {
+                // only the wake-up matters, the events themselves are drained
+            }
+        }
+    }
+};
@@ -0,0 +1,196 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <cstring>
+
+#include <zlib.h>
+
+// Returns true if <path> names a gzip-compressed log, e.g. 20240520.ibfs.gz
+bool isGzipPath(std::string_view path) {
+    return path.size() > 3 && path.substr(path.size() - 3) == ".gz";
+}
+
+// <path> without a trailing ".gz", so 20240520.ibfs.gz is dated and typed like 20240520.ibfs
+std::string stripGzipSuffix(const std::string& path) {
+    return isGzipPath(path) ? path.substr(0, path.size() - 3) : path;
+}
+
+// Gzip-compressed log that hands out one line at a time, with the same
+// interface as MappedLog, so archived logs never have to be decompressed to
+// disk.
+//
+// A producer thread inflates the file into chunks of about <chunkSize> bytes,
+// each cut after its last '\n' (the partial line is carried over to the next
+// chunk), and queues up to QUEUE_DEPTH of them, so decompression runs ahead of
+// and overlaps with the parsing done by the reader. Chunk buffers are handed
+// back to the producer once read and reused.
+//
+// Unlike MappedLog, a line view only stays valid until the next call to
+// nextLine() that moves on to a new chunk; copy the line if it is needed longer.
+//
+// For example:
+//      GzipLog log("20240520.ibfs.gz");
+//      std::string_view line;
+//      while (log.isOpen() && log.nextLine(line)) { ... }
+//      if (log.failed()) std::cerr << log.error();
+class GzipLog {
+public:
+    static constexpr size_t DEFAULT_CHUNK_SIZE = 1 << 20;
+    static constexpr size_t QUEUE_DEPTH = 4;
+
+    explicit GzipLog(const std::string& path, size_t chunkSize = DEFAULT_CHUNK_SIZE) {
+        file_ = gzopen(path.c_str(), "rb");
+        if (!file_) {
+            done_ = true; // nothing will ever be queued
+            return;
+        }
+        gzbuffer(file_, 256 * 1024);
+        opened_ = true;
+        producer_ = std::thread(&GzipLog::produce, this, chunkSize > 0 ? chunkSize : DEFAULT_CHUNK_SIZE);
+    }
+
+    ~GzipLog() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true; // the reader may stop early, e.g. once past the last check point
+        }
+        space_.notify_all();
+        if (producer_.joinable())
+            producer_.join();
+        if (file_)
+            gzclose(file_);
+    }
+
+    GzipLog(const GzipLog&) = delete;
+    GzipLog& operator=(const GzipLog&) = delete;
+
+    bool isOpen() const { return opened_; }
+
+    // true if the stream turned out to be corrupt or truncated, only meaningful
+    // once nextLine() has returned false
+    bool failed() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return !error_.empty();
+    }
+
+    std::string error() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return error_;
+    }
+
+    // Stores the next line in <line> and returns true, or returns false once
+    // the whole file has been read (or decompression failed)
+    bool nextLine(std::string_view& line) {
+        while (pos_ >= current_.size()) {
+            if (!nextChunk())
+                return false;
+        }
+        const char* start = current_.data() + pos_;
+        size_t remaining = current_.size() - pos_;
+        const char* eol = static_cast<const char*>(std::memchr(start, '\n', remaining));
+        size_t len = eol ? static_cast<size_t>(eol - start) : remaining;
+        line = std::string_view(start, len);
+        pos_ += eol ? len + 1 : len;
+        return true;
+    }
+
+private:
+    gzFile file_ = nullptr;
+    bool opened_ = false;
+    std::thread producer_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable ready_; // a chunk was queued or the producer is done
+    std::condition_variable space_; // a chunk was taken off the queue or the reader is gone
+    std::deque<std::string> full_;  // inflated chunks waiting to be read, in file order
+    std::vector<std::string> free_; // read chunks, for the producer to reuse
+    bool done_ = false;
+    bool stop_ = false;
+    std::string error_;
+
+    std::string current_; // chunk being read, only touched by the reader
+    size_t pos_ = 0;
+
+    // Recycles the chunk just read and waits for the next one, false at the end of the file
+    bool nextChunk() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (current_.capacity() > 0) {
+            free_.push_back(std::move(current_));
+            current_ = std::string();
+        }
+        ready_.wait(lock, [this] { return !full_.empty() || done_; });
+        if (full_.empty())
+            return false;
+        current_ = std::move(full_.front());
+        full_.pop_front();
+        pos_ = 0;
+        lock.unlock();
+        space_.notify_one();
+        return true;
+    }
+
+    void produce(size_t chunkSize) {
+        std::string carry; // incomplete last line of the previous chunk
+        bool eof = false;
+        while (!eof) {
+            std::string chunk;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                space_.wait(lock, [this] { return stop_ || full_.size() < QUEUE_DEPTH; });
+                if (stop_)
+                    break;
+                if (!free_.empty()) {
+                    chunk = std::move(free_.back());
+                    free_.pop_back();
+                }
+            }
+            chunk.assign(carry);
+            carry.clear();
+            size_t have = chunk.size();
+            chunk.resize(have + chunkSize);
+            int n = gzread(file_, &chunk[have], static_cast<unsigned>(chunkSize));
+            if (n < 0) {
+                setError();
+                break;
+            }
+            chunk.resize(have + static_cast<size_t>(n));
+            if (static_cast<size_t>(n) < chunkSize) {
+                eof = true; // gzread only returns less than asked for at the end of the stream
+                int err = Z_OK;
+                gzerror(file_, &err);
+                if (err != Z_OK)
+                    setError(); // e.g. a truncated archive, still hand out what was inflated
+            } else {
+                const char* eol = static_cast<const char*>(memrchr(chunk.data(), '\n', chunk.size()));
+                size_t keep = eol ? static_cast<size_t>(eol - chunk.data()) + 1 : 0;
+                carry.assign(chunk, keep, std::string::npos); // a line longer than a chunk keeps growing here
+                chunk.resize(keep);
+            }
+            if (chunk.empty())
+                continue;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                full_.push_back(std::move(chunk));
+            }
+            ready_.notify_one();
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            done_ = true;
+        }
+        ready_.notify_all();
+    }
+
+    void setError() {
+        int err = Z_OK;
+        const char* msg = gzerror(file_, &err);
+        std::lock_guard<std::mutex> lock(mutex_);
+        error_ = msg && *msg ? msg : "gzip read error";
+    }
+};
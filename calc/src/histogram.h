@@ -0,0 +1,158 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+
+// Fixed-memory log-linear histogram of non-negative integer values, in the
+// spirit of HdrHistogram. Values below 2^SUB_BUCKET_BITS are counted exactly;
+// above that every power-of-two range is split into 2^(SUB_BUCKET_BITS-1)
+// equally wide buckets, so any recorded value is known to within
+// 1 / 2^(SUB_BUCKET_BITS-1) of itself (about 1.6% with the default of 7 bits)
+// no matter how large it is.
+//
+// Histograms with the same SUB_BUCKET_BITS merge by adding their counts, so the
+// distribution of a month is the merge of its days' histograms, without
+// keeping any raw samples around.
+//
+// For example:
+//      LogLinearHistogram daily;
+//      daily.record(activeOrders);
+//      monthly.merge(daily);
+//      monthly.valueAtPercentile(99.0);
+class LogLinearHistogram {
+public:
+    static constexpr unsigned SUB_BUCKET_BITS = 7;
+
+    LogLinearHistogram() : counts_(bucketCount(), 0) {}
+
+    // counts <value> <count> times, negative values are counted as 0
+    void record(int64_t value, uint64_t count = 1) {
+        uint64_t v = value < 0 ? 0 : static_cast<uint64_t>(value);
+        counts_[bucketOf(v)] += count;
+        total_ += count;
+        if (v > max_)
+            max_ = v;
+    }
+
+    void merge(const LogLinearHistogram& other) {
+        for (size_t i = 0; i < counts_.size(); ++i) {
+            counts_[i] += other.counts_[i];
+        }
+        total_ += other.total_;
+        if (other.max_ > max_)
+            max_ = other.max_;
+    }
+
+    uint64_t totalCount() const { return total_; }
+    uint64_t max() const { return max_; }
+
+    // smallest value v such that at least <percentile>% of the recorded values
+    // are <= v, reported as the upper end of its bucket (0 if nothing was recorded)
+    uint64_t valueAtPercentile(double percentile) const {
+        if (total_ == 0)
+            return 0;
+        double wanted = percentile / 100.0 * total_;
+        uint64_t target = wanted < 1.0 ? 1 : static_cast<uint64_t>(wanted + 0.5);
+        if (target > total_)
+            target = total_;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts_.size(); ++i) {
+            seen += counts_[i];
+            if (seen >= target) {
+                uint64_t upper = highestValueOf(i);
+                return upper < max_ ? upper : max_;
+            }
+        }
+        return max_;
+    }
+
+    // Serialized layout (little-endian): "LLH1", SUB_BUCKET_BITS as uint32, max
+    // as uint64, then (bucket index as uint32, count as uint64) for every
+    // non-empty bucket. Only non-empty buckets are stored, a day of samples
+    // typically needs a few hundred bytes.
+    std::vector<uint8_t> serialize() const {
+        std::vector<uint8_t> out;
+        out.insert(out.end(), MAGIC, MAGIC + 4);
+        put(out, static_cast<uint32_t>(SUB_BUCKET_BITS));
+        put(out, max_);
+        for (size_t i = 0; i < counts_.size(); ++i) {
+            if (counts_[i] != 0) {
+                put(out, static_cast<uint32_t>(i));
+                put(out, counts_[i]);
+            }
+        }
+        return out;
+    }
+
+    // inverse of serialize(), nullopt if <data> is not a serialized histogram
+    // with the same layout
+    static std::optional<LogLinearHistogram> deserialize(const uint8_t* data, size_t size) {
+        const size_t header = 4 + sizeof(uint32_t) + sizeof(uint64_t);
+        const size_t entry = sizeof(uint32_t) + sizeof(uint64_t);
+        if (!data || size < header || (size - header) % entry != 0 || std::memcmp(data, MAGIC, 4) != 0)
+            return std::nullopt;
+        if (get<uint32_t>(data + 4) != SUB_BUCKET_BITS)
+            return std::nullopt;
+        LogLinearHistogram histogram;
+        histogram.max_ = get<uint64_t>(data + 8);
+        for (size_t pos = header; pos < size; pos += entry) {
+            uint32_t index = get<uint32_t>(data + pos);
+            if (index >= histogram.counts_.size())
+                return std::nullopt;
+            uint64_t count = get<uint64_t>(data + pos + sizeof(uint32_t));
+            histogram.counts_[index] += count;
+            histogram.total_ += count;
+        }
+        return histogram;
+    }
+
+private:
+    static constexpr uint8_t MAGIC[4] = {'L', 'L', 'H', '1'};
+    static constexpr uint64_t SUB_BUCKETS = uint64_t(1) << SUB_BUCKET_BITS;
+    static constexpr uint64_t HALF = SUB_BUCKETS / 2;
+
+    std::vector<uint64_t> counts_;
+    uint64_t total_ = 0;
+    uint64_t max_ = 0;
+
+    // values below SUB_BUCKETS get one bucket each, then every power of two up
+    // to 2^63 adds HALF buckets
+    static size_t bucketCount() { return SUB_BUCKETS + (64 - SUB_BUCKET_BITS) * HALF; }
+
+    static size_t bucketOf(uint64_t v) {
+        if (v < SUB_BUCKETS)
+            return static_cast<size_t>(v);
+        unsigned msb = 63 - __builtin_clzll(v);        // v is in [2^msb, 2^(msb+1))
+        unsigned shift = msb - (SUB_BUCKET_BITS - 1); // width of a bucket is 2^shift
+        uint64_t sub = (v >> shift) - HALF;           // 0 .. HALF-1 within the range
+        return static_cast<size_t>(SUB_BUCKETS + (msb - SUB_BUCKET_BITS) * HALF + sub);
+    }
+
+    static uint64_t highestValueOf(size_t bucket) {
+        if (bucket < SUB_BUCKETS)
+            return bucket;
+        size_t range = (bucket - SUB_BUCKETS) / HALF;
+        uint64_t sub = (bucket - SUB_BUCKETS) % HALF;
+        unsigned shift = static_cast<unsigned>(range) + 1;
+        uint64_t lowest = (HALF + sub) << shift;
+        return lowest + ((uint64_t(1) << shift) - 1);
+    }
+
+    template <typename T>
+    static void put(std::vector<uint8_t>& out, T value) {
+        for (size_t i = 0; i < sizeof(T); ++i) {
+            out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+        }
+    }
+
+    template <typename T>
+    static T get(const uint8_t* in) {
+        T value = 0;
+        for (size_t i = 0; i < sizeof(T); ++i) {
+            value |= static_cast<T>(in[i]) << (8 * i);
+        }
+        return value;
+    }
+};
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <optional>
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <cstdint>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// Find the first occurrence of <needle> in <haystack> at or after <from> and
+// return its position, or std::string_view::npos if there is none.
+//
+// With AVX2 available (e.g. -march=native, see CALC_NATIVE_ARCH) 32 candidate
+// positions are tested at once by comparing the first and last byte of the
+// needle, and only positions where both match are verified with memcmp.
+// Otherwise candidates are located with memchr on the first byte, which glibc
+// already vectorizes.
+size_t findSubstring(std::string_view haystack, std::string_view needle, size_t from = 0) {
+    if (from > haystack.size() || needle.size() > haystack.size() - from)
+        return std::string_view::npos;
+    const char* s = haystack.data() + from;
+    const size_t n = haystack.size() - from;
+    const size_t k = needle.size();
+    if (k == 0)
+        return from;
+    if (k == 1) {
+        const void* hit = std::memchr(s, needle[0], n);
+        return hit ? from + (static_cast<const char*>(hit) - s) : std::string_view::npos;
+    }
+
+    size_t i = 0;
+#if defined(__AVX2__)
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last = _mm256_set1_epi8(needle[k - 1]);
+    for (; i + k + 31 <= n; i += 32) {
+        __m256i blockFirst = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i));
+        __m256i blockLast = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i + k - 1));
+        __m256i eq = _mm256_and_si256(_mm256_cmpeq_epi8(first, blockFirst), _mm256_cmpeq_epi8(last, blockLast));
+        uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(eq));
+        while (mask != 0) {
+            unsigned bit = __builtin_ctz(mask);
+            if (std::memcmp(s + i + bit + 1, needle.data() + 1, k - 2) == 0)
+                return from + i + bit;
+            mask &= mask - 1;
+        }
+    }
+#endif
+    // scalar path, also handles the tail the vector loop could not cover
+    while (i + k <= n) {
+        const void* hit = std::memchr(s + i, needle[0], n - k + 1 - i);
+        if (!hit)
+            break;
+        i = static_cast<const char*>(hit) - s;
+        if (std::memcmp(s + i + 1, needle.data() + 1, k - 1) == 0)
+            return from + i;
+        ++i;
+    }
+    return std::string_view::npos;
+}
+
+// Pre-filter that keeps only the log entries calc cares about, so raw logs can
+// be fed to calc directly. The defaults are equivalent to
+//
+//      grep -a -E '.*OrderUpdate.*C70|.*OrderReport.*C70|.*\[MatchReport\].*IntraDayOdd.*Buy'
+//
+// i.e. an entry is accepted if it carries one of the order tags followed later
+// by one of the strategy prefixes, or the match tag followed by the session and
+// the side.
+struct LogFilter {
+    std::vector<std::string> orderTags = {"OrderUpdate", "OrderReport"};
+    std::vector<std::string> strategyPrefixes = {"C70"};
+    std::string matchTag = "[MatchReport]";
+    std::string session = "IntraDayOdd";
+    std::string side = "Buy";
+
+    bool accept(std::string_view line) const {
+        for (const auto& tag : orderTags) {
+            size_t pos = findSubstring(line, tag);
+            if (pos == std::string_view::npos)
+                continue;
+            for (const auto& prefix : strategyPrefixes) {
+                if (findSubstring(line, prefix, pos + tag.size()) != std::string_view::npos)
+                    return true;
+            }
+        }
+        size_t pos = findSubstring(line, matchTag);
+        if (pos == std::string_view::npos)
+            return false;
+        pos = findSubstring(line, session, pos + matchTag.size());
+        if (pos == std::string_view::npos)
+            return false;
+        return findSubstring(line, side, pos + session.size()) != std::string_view::npos;
+    }
+};
+
+// Most strategy prefixes one run can keep apart, see OrderEvent::strategy
+const size_t MAX_STRATEGIES = 255;
+
+// Parse a comma-separated list of strategy prefixes, e.g. "C70,C71". Each
+// prefix also names a table (see statsTable()), so only letters, digits and
+// '_' are allowed.
+//
+// Returns nullopt if any entry is empty or invalid, repeated, or there are
+// more than MAX_STRATEGIES
+std::optional<std::vector<std::string>> parseStrategyPrefixes(const std::string& text) {
+    std::vector<std::string> prefixes;
+    size_t pos = 0;
+    while (pos <= text.size()) {
+        size_t end = text.find(',', pos);
+        if (end == std::string::npos)
+            end = text.size();
+        std::string prefix = text.substr(pos, end - pos);
+        if (prefix.empty() || !std::all_of(prefix.begin(), prefix.end(), [](unsigned char c) { return std::isalnum(c) || c == '_'; }) ||
+            std::find(prefixes.begin(), prefixes.end(), prefix) != prefixes.end())
+            return std::nullopt;
+        prefixes.push_back(prefix);
+        pos = end + 1;
+    }
+    if (prefixes.size() > MAX_STRATEGIES)
+        return std::nullopt;
+    return prefixes;
+}
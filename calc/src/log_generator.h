@@ -0,0 +1,357 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <queue>
+#include <random>
+#include <functional>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include "calc.h"
+#include "ticks.h"
+
+// Shape of a synthetic log, see LogGenerator
+struct LogGeneratorOptions {
+    uint64_t seed = 1;
+    size_t orders = 100000;     // new orders over the session
+    double cancelRatio = 0.3;   // share of the orders canceled (after any partial fills) instead of filled completely
+    double meanFills = 1.5;     // mean match reports per order, geometric and at least 1; 1 fills (or cancels) every order at once
+    size_t symbols = 200;       // stock codes, with Zipf popularity so a few of them carry most orders
+    std::vector<std::string> strategies = {"C70"}; // strategy prefixes, each order belongs to one of them at random
+    double burstiness = 0.3;    // share of the orders arriving in bursts, the others arrive evenly over the session
+    size_t bursts = 20;         // bursts over the session, each a minute or two wide
+    double meanLifeSeconds = 60; // mean time from an order to its cancel or last fill
+    double noiseRatio = 0;      // other entries (heartbeats) per order entry as in raw logs, calc -p filters them out
+    double malformedRatio = 0;  // share of the new orders written with a garbled price, calc warns and ignores them
+    TimeOfDay sessionStart = 9 * 3600 * MICROS_PER_SECOND + 10 * 60 * MICROS_PER_SECOND; // 09:10, orders arrive until sessionEnd
+    TimeOfDay sessionEnd = 13 * 3600 * MICROS_PER_SECOND + 30 * 60 * MICROS_PER_SECOND;  // 13:30, fills and cancels may come later
+};
+
+// Writes a synthetic log entry by entry, in time order and in the layout of the
+// real logs (order ID at offset 76, see parseOrderEvent()), for benchmarks and
+// stress tests of calc at any volume.
+//
+// Orders arrive evenly over the session plus <burstiness> of them in bursts.
+// Every order then gets one or more match reports and, if it is canceled, a
+// cancel of its remaining shares, at exponentially distributed delays. Entries
+// are generated as they are written: memory grows with the orders live at once,
+// never with the length of the log, so a log of 100M lines streams as easily as
+// one of a thousand. The same options (seed included) always give the same log.
+//
+// For example:
+//      LogGeneratorOptions options;
+//      options.orders = 1000000;
+//      LogGenerator generator(options);
+//      std::string line;
+//      while (generator.nextLine(line)) { std::cout << line << '\n'; }
+class LogGenerator {
+public:
+    explicit LogGenerator(LogGeneratorOptions options)
+        : options_(std::move(options)), random_(options_.seed), arrivalsLeft_(options_.orders) {
+        if (options_.strategies.empty())
+            options_.strategies = {"C70"};
+        if (options_.symbols == 0)
+            options_.symbols = 1;
+        for (const auto& prefix : options_.strategies) {
+            // a strategy field of ten characters, as in the real logs (e.g. C703002017)
+            strategyFields_.push_back(prefix + std::string("3002017").substr(0, prefix.size() < 10 ? 10 - prefix.size() : 0));
+        }
+        double popularity = 0;
+        for (size_t i = 0; i < options_.symbols; ++i) {
+            symbolNames_.push_back(std::to_string(1101 + i));
+            symbolCdf_.push_back(popularity += 1.0 / static_cast<double>(i + 1));
+            // base prices log-uniform between 10 and 1000
+            symbolPrices_.push_back(static_cast<Ticks>(std::exp(std::log(10.0) + uniform() * std::log(100.0)) * TICKS_PER_UNIT));
+        }
+        for (double& p : symbolCdf_) {
+            p /= popularity;
+        }
+        buildArrivalCdf();
+    }
+
+    // Stores the next entry (without a trailing newline) in <line>, returns
+    // false once every order is done
+    bool nextLine(std::string& line) {
+        if (noiseLeft_ > 0) {
+            --noiseLeft_;
+            writeNoise(line);
+            return true;
+        }
+        if (hasPending_) {
+            line.swap(pending_);
+            hasPending_ = false;
+            return true;
+        }
+        if (!nextOrderEntry(pending_))
+            return false;
+        hasPending_ = true;
+        noiseLeft_ = static_cast<size_t>(options_.noiseRatio);
+        if (uniform() < options_.noiseRatio - static_cast<double>(noiseLeft_))
+            ++noiseLeft_;
+        return nextLine(line);
+    }
+
+    const std::vector<std::string>& symbolNames() const { return symbolNames_; } // stock codes, most popular first
+
+private:
+    // an order between its arrival and its last entry
+    struct LiveOrder {
+        uint64_t id;        // sequence number, written as 5 base-62 characters
+        uint32_t symbol;
+        uint8_t strategy;
+        bool canceled;      // ends with a cancel instead of a last fill
+        Ticks price;
+        int shares;         // not filled yet
+        int entriesLeft;    // match reports and cancel still to come
+    };
+
+    // the next entry of a live order
+    struct Due {
+        TimeOfDay time;
+        uint64_t sequence;  // ties go to the entry scheduled first
+        uint32_t slot;      // in orders_
+        bool operator>(const Due& other) const {
+            return time != other.time ? time > other.time : sequence > other.sequence;
+        }
+    };
+
+    LogGeneratorOptions options_;
+    std::mt19937_64 random_; // its output is fixed by the standard, unlike the std distributions, so is the log
+    std::vector<std::string> strategyFields_;
+    std::vector<std::string> symbolNames_;
+    std::vector<double> symbolCdf_;
+    std::vector<Ticks> symbolPrices_;
+    std::vector<double> arrivalCdf_; // share of the arrivals before each second of the session
+    size_t arrivalSecond_ = 0;       // second of the previous arrival
+    size_t arrivalsLeft_;
+    double arrivalQuantile_ = 0;     // of the previous arrival, arrivals are drawn as ascending quantiles
+    bool hasArrival_ = false;
+    TimeOfDay arrival_ = 0;          // drawn but not written yet if hasArrival_
+    uint64_t nextOrderId_ = 0;
+    uint64_t nextSequence_ = 0;
+    std::vector<LiveOrder> orders_;
+    std::vector<uint32_t> freeSlots_;
+    std::priority_queue<Due, std::vector<Due>, std::greater<Due>> due_;
+    TimeOfDay time_ = 0;             // of the latest order entry, noise is written at it
+    std::string pending_;            // order entry to write after its noise
+    bool hasPending_ = false;
+    size_t noiseLeft_ = 0;
+
+    // uniform in [0, 1)
+    double uniform() { return static_cast<double>(random_() >> 11) * 0x1.0p-53; }
+
+    double exponential(double mean) { return -std::log(1.0 - uniform()) * mean; }
+
+    // A uniform background plus one Gaussian bump per burst, accumulated per second
+    void buildArrivalCdf() {
+        size_t seconds = options_.sessionEnd > options_.sessionStart + MICROS_PER_SECOND ?
+            static_cast<size_t>((options_.sessionEnd - options_.sessionStart) / MICROS_PER_SECOND) : 1;
+        double burstiness = options_.bursts > 0 ? std::clamp(options_.burstiness, 0.0, 1.0) : 0.0;
+        std::vector<double> weights(seconds, (1.0 - burstiness) / static_cast<double>(seconds));
+        for (size_t b = 0; b < options_.bursts; ++b) {
+            double center = uniform() * static_cast<double>(seconds);
+            double width = 30 + uniform() * 60; // standard deviation in seconds
+            std::vector<double> bump(seconds);
+            double total = 0;
+            for (size_t s = 0; s < seconds; ++s) {
+                double z = (static_cast<double>(s) + 0.5 - center) / width;
+                total += bump[s] = z * z < 32 ? std::exp(-0.5 * z * z) : 0.0;
+            }
+            for (size_t s = 0; s < seconds; ++s) {
+                weights[s] += burstiness / static_cast<double>(options_.bursts) * bump[s] / total;
+            }
+        }
+        arrivalCdf_.assign(1, 0.0);
+        for (double weight : weights) {
+            arrivalCdf_.push_back(arrivalCdf_.back() + weight);
+        }
+        for (double& p : arrivalCdf_) {
+            p /= arrivalCdf_.back();
+        }
+    }
+
+    // Time of the next arrival. The quantiles of n uniform draws are generated in
+    // ascending order directly (the smallest of n uniforms is 1 - U^(1/n)), so
+    // arrivals come in time order without drawing and sorting them all first.
+    TimeOfDay nextArrivalTime() {
+        arrivalQuantile_ = 1.0 - (1.0 - arrivalQuantile_) * std::pow(uniform(), 1.0 / static_cast<double>(arrivalsLeft_));
+        --arrivalsLeft_;
+        while (arrivalSecond_ + 2 < arrivalCdf_.size() && arrivalCdf_[arrivalSecond_ + 1] <= arrivalQuantile_) {
+            ++arrivalSecond_;
+        }
+        double low = arrivalCdf_[arrivalSecond_], high = arrivalCdf_[arrivalSecond_ + 1];
+        double fraction = high > low ? std::min((arrivalQuantile_ - low) / (high - low), 1.0) : 0.0;
+        TimeOfDay time = options_.sessionStart + static_cast<TimeOfDay>((static_cast<double>(arrivalSecond_) + fraction) * MICROS_PER_SECOND);
+        return std::max(time, time_); // rounding must not move the clock back
+    }
+
+    bool nextOrderEntry(std::string& line) {
+        if (arrivalsLeft_ > 0 || hasArrival_) {
+            TimeOfDay arrival = nextArrivalTimeCached();
+            if (due_.empty() || arrival <= due_.top().time) {
+                hasArrival_ = false;
+                time_ = arrival;
+                writeNewOrder(line);
+                return true;
+            }
+        }
+        if (due_.empty())
+            return false;
+        Due due = due_.top();
+        due_.pop();
+        time_ = due.time;
+        writeUpdate(line, due.slot);
+        return true;
+    }
+
+    // the next arrival, drawn once and kept until it is written
+    TimeOfDay nextArrivalTimeCached() {
+        if (!hasArrival_) {
+            arrival_ = nextArrivalTime();
+            hasArrival_ = true;
+        }
+        return arrival_;
+    }
+
+    void writeNewOrder(std::string& line) {
+        LiveOrder order{};
+        order.id = nextOrderId_++;
+        double pick = uniform();
+        order.symbol = static_cast<uint32_t>(std::lower_bound(symbolCdf_.begin(), symbolCdf_.end() - 1, pick) - symbolCdf_.begin());
+        order.strategy = static_cast<uint8_t>(random_() % strategyFields_.size());
+        Ticks base = symbolPrices_[order.symbol];
+        order.price = std::max<Ticks>(1, base + static_cast<Ticks>((uniform() - 0.5) * 0.02 * static_cast<double>(base)));
+        order.shares = 1 + static_cast<int>(random_() % 999); // odd lots
+        order.canceled = uniform() < options_.cancelRatio;
+        int entries = 1;
+        if (options_.meanFills > 1)
+            entries += static_cast<int>(std::log(1.0 - uniform()) / std::log(1.0 - 1.0 / options_.meanFills));
+        order.entriesLeft = std::min(entries, order.shares);
+        if (uniform() < options_.malformedRatio) {
+            writeEntry(line, "11", "[Trace][][OrderReport]", order, order.price, order.shares, " 0000=OrderSuccess", true);
+            return; // calc ignores the order, so nothing else is written for it
+        }
+        writeEntry(line, "11", "[Trace][][OrderReport]", order, order.price, order.shares, " 0000=OrderSuccess");
+        uint32_t slot;
+        if (freeSlots_.empty()) {
+            slot = static_cast<uint32_t>(orders_.size());
+            orders_.push_back(order);
+        } else {
+            slot = freeSlots_.back();
+            freeSlots_.pop_back();
+            orders_[slot] = order;
+        }
+        schedule(slot);
+    }
+
+    void schedule(uint32_t slot) {
+        double delay = exponential(options_.meanLifeSeconds / orders_[slot].entriesLeft);
+        due_.push(Due{time_ + static_cast<TimeOfDay>(delay * MICROS_PER_SECOND), nextSequence_++, slot});
+    }
+
+    // a fill of part of the order, or its last entry
+    void writeUpdate(std::string& line, uint32_t slot) {
+        LiveOrder& order = orders_[slot];
+        if (order.entriesLeft == 1) {
+            if (order.canceled) {
+                writeEntry(line, "11", "[Trace][][OrderUpdate]", order, order.price, order.shares, " 0000=CancelSuccess");
+            } else {
+                writeEntry(line, "12", "[Trace][][MatchReport]", order, order.price, order.shares, "");
+            }
+            freeSlots_.push_back(slot);
+            return;
+        }
+        // a fill of half to one and a half times an even split of what is left,
+        // leaving at least one share for every entry still to come
+        int fills = order.canceled ? order.entriesLeft - 1 : order.entriesLeft;
+        int shares = static_cast<int>(static_cast<double>(order.shares) / fills * (0.5 + uniform()));
+        shares = std::clamp(shares, 1, order.shares - (order.entriesLeft - 1));
+        writeEntry(line, "12", "[Trace][][MatchReport]", order, order.price, shares, "");
+        order.shares -= shares;
+        --order.entriesLeft;
+        schedule(slot);
+    }
+
+    // The fields up to the order ID have fixed widths, which puts the order ID at
+    // offset 76 as calc expects. <line> keeps its capacity from entry to entry,
+    // so writing an entry does not allocate.
+    void writeEntry(std::string& line, const char* thread, const char* tag, const LiveOrder& order,
+                    Ticks price, int shares, const char* status, bool malformed = false) {
+        line.clear();
+        appendTimestamp(line, time_, 6);
+        line.append(" ").append(thread).append(" ").append(tag).append("Tradetron ");
+        appendTimestamp(line, exchangeTime(), 3);
+        line.append(" 779c0098490 ");
+        uint64_t n = order.id;
+        line.append(5, '0');
+        for (size_t i = line.size(); i-- > line.size() - 5; n /= 62) {
+            line[i] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz"[n % 62];
+        }
+        line.append(" ").append(strategyFields_[order.strategy]).append(" ").append(symbolNames_[order.symbol]);
+        line.append(" IntraDayOdd ROD Buy ").append(malformed ? "1x" : "");
+        appendPrice(line, price);
+        line.append(" ");
+        appendNumber(line, shares);
+        line.append(status).append(" RR");
+    }
+
+    void writeNoise(std::string& line) {
+        line.clear();
+        appendTimestamp(line, time_, 6);
+        line.append(" 10 [Info][][Heartbeat]Tradetron ");
+        appendTimestamp(line, exchangeTime(), 3);
+        line.append(" 779c0098490 session alive, no order activity to report here");
+    }
+
+    // the exchange clock of an entry, a little behind ours
+    TimeOfDay exchangeTime() {
+        TimeOfDay lag = static_cast<TimeOfDay>(random_() % 2000);
+        return time_ > lag ? time_ - lag : 0;
+    }
+
+    // HH:MM:SS followed by <fractionDigits> digits of the second, e.g. 09:13:06.011
+    static void appendTimestamp(std::string& text, TimeOfDay time, int fractionDigits) {
+        int64_t seconds = time / MICROS_PER_SECOND;
+        int64_t fraction = time % MICROS_PER_SECOND;
+        appendDigits(text, seconds / 3600, 2);
+        text += ':';
+        appendDigits(text, seconds / 60 % 60, 2);
+        text += ':';
+        appendDigits(text, seconds % 60, 2);
+        text += '.';
+        for (int i = fractionDigits; i < 6; ++i) {
+            fraction /= 10;
+        }
+        appendDigits(text, fraction, fractionDigits);
+    }
+
+    // <value> zero-padded to <digits> digits
+    static void appendDigits(std::string& text, int64_t value, int digits) {
+        text.append(static_cast<size_t>(digits), '0');
+        for (size_t i = text.size(); digits-- > 0; value /= 10) {
+            text[--i] = static_cast<char>('0' + value % 10);
+        }
+    }
+
+    static void appendNumber(std::string& text, int64_t value) {
+        int digits = 1;
+        for (int64_t rest = value / 10; rest > 0; rest /= 10) {
+            ++digits;
+        }
+        appendDigits(text, value, digits);
+    }
+
+    // as in the logs, e.g. 10950 -> "109.5" and 10000 -> "100"
+    static void appendPrice(std::string& text, Ticks price) {
+        appendNumber(text, price / TICKS_PER_UNIT);
+        Ticks cents = price % TICKS_PER_UNIT;
+        if (cents != 0) {
+            text += '.';
+            text += static_cast<char>('0' + cents / 10);
+            if (cents % 10 != 0)
+                text += static_cast<char>('0' + cents % 10);
+        }
+    }
+};
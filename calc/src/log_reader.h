@@ -0,0 +1,96 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Read-only, memory-mapped view of a log file that hands out one line at a time
+// as a std::string_view pointing straight into the mapping, so the caller never
+// copies a line. Lines are split on '\n' (the '\n' itself is not part of the
+// line, same as std::getline). The views stay valid for the lifetime of the
+// MappedLog object.
+//
+// For example:
+//      MappedLog log("20240520.ibfs");
+//      std::string_view line;
+//      while (log.isOpen() && log.nextLine(line)) { ... }
+class MappedLog {
+public:
+    explicit MappedLog(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return;
+        struct stat st;
+        if (fstat(fd, &st) == 0) {
+            size_ = static_cast<size_t>(st.st_size);
+            if (size_ == 0) {
+                opened_ = true; // empty file is valid, there is simply nothing to read
+            } else {
+                void* addr = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (addr != MAP_FAILED) {
+                    data_ = static_cast<const char*>(addr);
+                    opened_ = true;
+                    // we scan the file once front to back, let the kernel read ahead aggressively
+                    madvise(addr, size_, MADV_SEQUENTIAL);
+                }
+            }
+        }
+        ::close(fd); // the mapping keeps its own reference to the file
+    }
+
+    ~MappedLog() {
+        if (data_)
+            munmap(const_cast<char*>(data_), size_);
+    }
+
+    MappedLog(const MappedLog&) = delete;
+    MappedLog& operator=(const MappedLog&) = delete;
+
+    bool isOpen() const { return opened_; }
+    size_t size() const { return size_; }
+    const char* data() const { return data_; }
+
+    // Stores the next line in <line> and returns true, or returns false once
+    // the end of the mapping has been reached
+    bool nextLine(std::string_view& line) {
+        if (pos_ >= size_)
+            return false;
+        const char* start = data_ + pos_;
+        size_t remaining = size_ - pos_;
+        const char* eol = static_cast<const char*>(std::memchr(start, '\n', remaining));
+        size_t len = eol ? static_cast<size_t>(eol - start) : remaining;
+        line = std::string_view(start, len);
+        pos_ += eol ? len + 1 : len;
+        return true;
+    }
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    size_t pos_ = 0;
+    bool opened_ = false;
+};
+
+// Split <text> into at most <parts> pieces of about the same size, each cut
+// right after a '\n', so every line lies entirely within one piece and the
+// pieces can be parsed independently (e.g. in parallel).
+//
+// For example, splitLines("a\nb\nc\nd\n", 2) gives {"a\nb\n", "c\nd\n"}
+std::vector<std::string_view> splitLines(std::string_view text, size_t parts) {
+    std::vector<std::string_view> pieces;
+    size_t target = parts > 1 ? (text.size() + parts - 1) / parts : text.size();
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t end = pos + target >= text.size() ? text.size() : text.find('\n', pos + target - 1);
+        end = end == std::string_view::npos ? text.size() : end + (end < text.size());
+        pieces.push_back(text.substr(pos, end - pos));
+        pos = end;
+    }
+    return pieces;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cmath>
+
+#include "calc.h"
+#include "event_cache.h"
+#include "gzip_log.h"
+#include "order_replay.h"
+#include "ticks.h"
+#include "write2db.h"
+
+// Summarizes the samples a log was checked at into a LogStats record: date and
+// tt come from the log's name (e.g. 20240520.ibfs), then the mean, standard
+// deviation, min, max, median and <percentiles> of the active orders and amount.
+//
+// Arguments:
+//      <data> is the state at every check point of the interval
+//      <count> is the number of order updates in the log
+//      <intervalMicros> is the time between check points
+LogStats computeStats(std::string filename, const std::vector<ActiveOrderPair> &data, int count, TimeOfDay intervalMicros, const std::vector<double> &percentiles)
+{
+    filename = stripGzipSuffix(stripEventCacheSuffix(filename)); // 20240520.ibfs.gz and .ibfs.evc are dated and typed like 20240520.ibfs
+    size_t dotPos = filename.find_last_of('.'); // we might have relative path in fron (../dir/filename) hence use last of 
+    LogStats ret{};
+    ret.date = dotPos == std::string::npos || dotPos < 8 ? 0 : parseUnsigned<int>(std::string_view(filename).substr(dotPos - 8, 8)).value_or(0);
+    ret.tt = dotPos == std::string::npos ? "" : filename.substr(dotPos + 1);
+    ret.numberOfLogs = count;
+    ret.intervalSeconds = static_cast<double>(intervalMicros) / MICROS_PER_SECOND;
+    ret.percentiles = percentiles;
+    if (data.empty()) {
+        ret.activeOrdersPercentiles.assign(percentiles.size(), 0.0);
+        ret.amountPercentiles.assign(percentiles.size(), 0.0);
+        return ret;
+    }
+
+    // Calculate mean and standard deviation incrementally to avoid overflow
+    std::vector<int> orders;
+    std::vector<Ticks> amounts;
+    orders.reserve(data.size());
+    amounts.reserve(data.size());
+    double mean_orders = 0.0;
+    double variance_order = 0.0;
+    double mean_amount = 0.0;
+    double variance_amount = 0.0;
+    int n = 0;
+    for (const auto& pair : data) {
+        ++n;
+        double delta = pair.first - mean_orders;
+        mean_orders += delta / n;
+        variance_order += delta * (pair.first - mean_orders);
+        delta = pair.second - mean_amount;
+        mean_amount += delta / n;
+        variance_amount += delta * (pair.second - mean_amount);
+        orders.push_back(pair.first);
+        amounts.push_back(pair.second);
+    }
+    // finalize variance and calculate standard deviation
+    ret.meanActiveOrders = mean_orders;
+    ret.stddevActiveOrders = std::sqrt(variance_order / n);
+    ret.meanAmount = mean_amount;
+    ret.stddevAmount = std::sqrt(variance_amount / n);
+
+    // max, min and median are just percentiles too, select them together with
+    // the requested ones instead of sorting
+    std::vector<double> wanted = percentiles;
+    wanted.insert(wanted.end(), {50.0, 0.0, 100.0});
+    std::vector<double> orderPercentiles = computePercentiles(orders, wanted);
+    std::vector<double> amountPercentiles = computePercentiles(amounts, wanted);
+    size_t k = percentiles.size();
+    ret.activeOrdersPercentiles.assign(orderPercentiles.begin(), orderPercentiles.begin() + k);
+    ret.amountPercentiles.assign(amountPercentiles.begin(), amountPercentiles.begin() + k);
+    ret.medianActiveOrders = orderPercentiles[k];
+    ret.maxActiveOrders = static_cast<int>(orderPercentiles[k + 2]);
+    ret.medianAmount = amountPercentiles[k];
+    ret.minAmount = static_cast<Ticks>(amountPercentiles[k + 1]);
+    ret.maxAmount = static_cast<Ticks>(amountPercentiles[k + 2]);
+    return ret;
+}
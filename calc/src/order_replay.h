@@ -0,0 +1,309 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <ostream>
+#include <utility>
+#include <algorithm>
+#include <limits>
+
+#include "calc.h"
+#include "histogram.h"
+#include "order_table.h"
+#include "symbol_table.h"
+#include "ticks.h"
+
+using ActiveOrderPair = std::pair<int, Ticks>; // <number of active orders, total order amount>
+
+// A log entry reduced to what the active order state machine needs. Entries
+// with a valid timestamp but no usable order update are kept as CLOCK_ONLY
+// events, they still move time (and hence check points) forward.
+struct OrderEvent {
+    static constexpr char CLOCK_ONLY = ' ';
+    static constexpr uint8_t UNROUTED = 0xFF; // strategy not known from the entry, see StrategyReplay
+
+    TimeOfDay time = 0;
+    OrderKey orderId = 0;
+    Ticks price = 0;
+    int shares = 0;
+    char status = CLOCK_ONLY; // 'O' new order, 'C' cancel order, 'M' match report
+    uint8_t strategy = 0;     // index of the strategy the order belongs to
+    uint32_t symbol = SymbolTable::NO_SYMBOL; // index of the stock code in the SymbolTable of the log, NO_SYMBOL if not tracked
+};
+
+// Active orders of one symbol and their amount in ticks
+struct SymbolExposure {
+    int activeOrders = 0;
+    Ticks amount = 0;
+};
+
+// Highest amount of one symbol seen at a check point, when it was and how many orders made it up
+struct SymbolPeak {
+    Ticks amount = 0;
+    TimeOfDay time = 0;
+    int activeOrders = 0;
+};
+
+// Samples of the active order state at the check points of one interval
+class CheckPointSeries {
+public:
+    CheckPointSeries(TimeOfDay interval, std::vector<TimeOfDay> checkTimes)
+        : interval_(interval), checkTimes_(std::move(checkTimes)), samples_(checkTimes_.size(), ActiveOrderPair(0, 0)) {}
+
+    TimeOfDay interval() const { return interval_; }
+    const std::vector<TimeOfDay>& checkTimes() const { return checkTimes_; }
+    const std::vector<ActiveOrderPair>& samples() const { return samples_; } // state at each check point
+    const LogLinearHistogram& activeOrdersHistogram() const { return activeOrdersHistogram_; }
+    const LogLinearHistogram& amountHistogram() const { return amountHistogram_; } // amount in ticks
+    const std::vector<SymbolPeak>& symbolPeaks() const { return symbolPeaks_; } // indexed by symbol, amount 0 if never exposed
+
+    bool done() const { return next_ == checkTimes_.size(); }
+
+    // the earliest check point not sampled yet, only valid if !done()
+    TimeOfDay nextCheckTime() const { return checkTimes_[next_]; }
+
+    // the exposure of <symbol> changed since the last sample
+    void markChanged(uint32_t symbol) {
+        if (symbol >= changed_.size()) {
+            changed_.resize(symbol + 1, false);
+            symbolPeaks_.resize(symbol + 1);
+            changedSymbols_.reserve(changed_.size()); // record() then never has to grow it
+        }
+        if (!changed_[symbol]) {
+            changed_[symbol] = true;
+            changedSymbols_.push_back(symbol);
+        }
+    }
+
+    // samples the next check point. Only the symbols marked as changed since the
+    // previous sample can have reached a new peak, the others are not looked at.
+    void record(int activeOrders, Ticks amount, const std::vector<SymbolExposure>& symbols) {
+        TimeOfDay checkTime = checkTimes_[next_];
+        samples_[next_++] = ActiveOrderPair(activeOrders, amount);
+        activeOrdersHistogram_.record(activeOrders);
+        amountHistogram_.record(amount);
+        for (uint32_t symbol : changedSymbols_) {
+            changed_[symbol] = false;
+            if (symbols[symbol].amount > symbolPeaks_[symbol].amount)
+                symbolPeaks_[symbol] = SymbolPeak{symbols[symbol].amount, checkTime, symbols[symbol].activeOrders};
+        }
+        changedSymbols_.clear();
+    }
+
+private:
+    TimeOfDay interval_;
+    std::vector<TimeOfDay> checkTimes_;
+    std::vector<ActiveOrderPair> samples_;
+    size_t next_ = 0;
+    LogLinearHistogram activeOrdersHistogram_; // distribution of the samples, kept for cross-day merging
+    LogLinearHistogram amountHistogram_;
+    std::vector<SymbolPeak> symbolPeaks_;
+    std::vector<bool> changed_;            // indexed by symbol
+    std::vector<uint32_t> changedSymbols_; // the symbols set in changed_
+};
+
+// The active order state machine, sampled at the check points of one or more
+// intervals at once, so every interval costs one pass over the events. Events
+// are fed in log order: advanceTo(event.time) first records the state at every
+// check point the event is past, then apply(event) updates the state.
+//
+// Next to the totals, the active orders and amount of every symbol are kept in
+// an array indexed by OrderEvent::symbol, and each series tracks the peak of
+// every symbol over its check points.
+//
+// For example:
+//      OrderReplay replay(firstCheckTime, lastCheckTime, {1 * MICROS_PER_SECOND, 30 * MICROS_PER_SECOND}, expectedOrders);
+//      for (const OrderEvent& event : events) {
+//          replay.advanceTo(event.time);
+//          if (replay.done())
+//              break;
+//          replay.apply(event);
+//      }
+//      replay.series(1).samples();
+class OrderReplay {
+public:
+    // check points every <intervals>[i] from <firstCheckTime> to <lastCheckTime>, see genCheckPoints()
+    OrderReplay(TimeOfDay firstCheckTime, TimeOfDay lastCheckTime, const std::vector<TimeOfDay>& intervals, size_t expectedOrders)
+        : activeOrders_(expectedOrders) {
+        for (TimeOfDay interval : intervals) {
+            series_.emplace_back(interval, genCheckPoints(firstCheckTime, lastCheckTime, interval));
+        }
+        updateNextCheckTime();
+    }
+
+    // print every sample to <trace> as it is taken, tagged with <label> if not
+    // empty; nullptr for none
+    void setTrace(std::ostream* trace, const std::string& label = "") {
+        trace_ = trace;
+        traceLabel_ = label;
+    }
+
+    // record the state as it is now at every check point before <now>
+    void advanceTo(TimeOfDay now) {
+        if (now <= nextCheckTime_)
+            return; // the common case, no check point in between
+        for (auto& series : series_) {
+            while (!series.done() && now > series.nextCheckTime()) {
+                if (trace_) {
+                    if (!traceLabel_.empty())
+                        *trace_ << "[" << traceLabel_ << "] ";
+                    *trace_ << "currTime=" << formatTimeOfDay(now) << " checkTime=" << formatTimeOfDay(series.nextCheckTime()) <<
+                    " [Active orders: " << activeOrders_.size() << "] [Amount: " << ticksToUnits(amount_) << "]";
+                    if (series_.size() > 1)
+                        *trace_ << " [Interval: " << static_cast<double>(series.interval()) / MICROS_PER_SECOND << "s]";
+                    *trace_ << std::endl;
+                }
+                series.record(static_cast<int>(activeOrders_.size()), amount_, symbols_);
+            }
+        }
+        updateNextCheckTime();
+    }
+
+    // true once every check point of every interval has been sampled, later events change nothing
+    bool done() const { return nextCheckTime_ == NEVER; }
+
+    void apply(const OrderEvent& event) {
+        switch (event.status) {
+            case 'O': // new order
+            {
+                amount_ += event.price * event.shares;
+                bool inserted = activeOrders_.insert(event.orderId, event.shares);
+                if (activeOrders_.size() > peakActiveOrders_)
+                    peakActiveOrders_ = activeOrders_.size();
+                updateSymbol(event, inserted ? 1 : 0, event.price * event.shares);
+                break;
+            }
+            case 'C': // cancel order
+            {
+                amount_ -= event.price * event.shares;
+                bool erased = activeOrders_.erase(event.orderId);
+                updateSymbol(event, erased ? -1 : 0, -event.price * event.shares);
+                break;
+            }
+            case 'M': // match report
+            {
+                int* remaining = activeOrders_.find(event.orderId);
+                if (remaining) {
+                    amount_ -= event.price * event.shares;
+                    *remaining -= event.shares;
+                    bool filled = *remaining == 0;
+                    if (filled) {
+                        activeOrders_.erase(event.orderId); // no qty remaining, remove it
+                    }
+                    updateSymbol(event, filled ? -1 : 0, -event.price * event.shares);
+                }
+                break;
+            }
+            default:
+                return; // only moves time forward
+        }
+        ++count_;
+    }
+
+    // true if <orderId> is an active order
+    bool hasOrder(OrderKey orderId) { return activeOrders_.find(orderId) != nullptr; }
+
+    // one series per interval, in the order the intervals were given
+    size_t seriesCount() const { return series_.size(); }
+    const CheckPointSeries& series(size_t i) const { return series_[i]; }
+    int count() const { return count_; } // order updates applied
+    size_t peakActiveOrders() const { return peakActiveOrders_; } // most orders active at once, check point or not
+    const std::vector<SymbolExposure>& symbols() const { return symbols_; } // current state, indexed by symbol
+
+private:
+    static constexpr TimeOfDay NEVER = std::numeric_limits<TimeOfDay>::max();
+
+    std::vector<CheckPointSeries> series_;
+    TimeOfDay nextCheckTime_ = NEVER; // earliest check point not sampled yet over all series
+    OrderTable activeOrders_;         // <orderId, qty>
+    Ticks amount_ = 0;                // exact sum of price * shares over the active orders
+    int count_ = 0;
+    size_t peakActiveOrders_ = 0;
+    std::ostream* trace_ = nullptr;
+    std::string traceLabel_;
+    std::vector<SymbolExposure> symbols_; // indexed by symbol, the amounts add up to amount_
+
+    // same bookkeeping as for the totals, for the symbol of <event>
+    void updateSymbol(const OrderEvent& event, int orders, Ticks amount) {
+        if (event.symbol == SymbolTable::NO_SYMBOL)
+            return;
+        if (event.symbol >= symbols_.size())
+            symbols_.resize(event.symbol + 1);
+        symbols_[event.symbol].activeOrders += orders;
+        symbols_[event.symbol].amount += amount;
+        for (auto& series : series_) {
+            series.markChanged(event.symbol);
+        }
+    }
+
+    void updateNextCheckTime() {
+        nextCheckTime_ = NEVER;
+        for (const auto& series : series_) {
+            if (!series.done() && series.nextCheckTime() < nextCheckTime_)
+                nextCheckTime_ = series.nextCheckTime();
+        }
+    }
+};
+
+// One OrderReplay per strategy, all fed from the same stream of events, so any
+// number of strategies costs one pass over the log. Every event goes to the
+// replay of its OrderEvent::strategy. A match report of unknown strategy
+// (OrderEvent::UNROUTED) goes to the strategy the order is active in, other
+// unrouted events only move time forward.
+//
+// For example:
+//      StrategyReplay replay(2, firstCheckTime, lastCheckTime, intervals, expectedOrders);
+//      ... same as OrderReplay ...
+//      replay.strategy(1).series(0).samples();
+class StrategyReplay {
+public:
+    StrategyReplay(size_t strategies, TimeOfDay firstCheckTime, TimeOfDay lastCheckTime, const std::vector<TimeOfDay>& intervals, size_t expectedOrders) {
+        for (size_t i = 0; i < (strategies > 0 ? strategies : 1); ++i) {
+            replays_.emplace_back(firstCheckTime, lastCheckTime, intervals, expectedOrders);
+        }
+    }
+
+    // see OrderReplay::setTrace(), <labels> tags the samples of each strategy
+    void setTrace(std::ostream* trace, const std::vector<std::string>& labels = {}) {
+        for (size_t i = 0; i < replays_.size(); ++i) {
+            replays_[i].setTrace(trace, i < labels.size() ? labels[i] : "");
+        }
+    }
+
+    void advanceTo(TimeOfDay now) {
+        for (auto& replay : replays_) {
+            replay.advanceTo(now);
+        }
+    }
+
+    // every strategy samples the same check points, so they are all done together
+    bool done() const { return replays_.front().done(); }
+
+    void apply(const OrderEvent& event) {
+        if (event.strategy < replays_.size()) {
+            replays_[event.strategy].apply(event);
+        } else if (event.status == 'M') {
+            for (auto& replay : replays_) {
+                if (replay.hasOrder(event.orderId)) {
+                    replay.apply(event);
+                    break;
+                }
+            }
+        }
+    }
+
+    size_t strategyCount() const { return replays_.size(); }
+    const OrderReplay& strategy(size_t i) const { return replays_[i]; }
+
+    // the most orders any one strategy had active at once, i.e. the fullest order table
+    size_t peakActiveOrders() const {
+        size_t peak = 0;
+        for (const auto& replay : replays_) {
+            peak = std::max(peak, replay.peakActiveOrders());
+        }
+        return peak;
+    }
+
+private:
+    std::vector<OrderReplay> replays_;
+};
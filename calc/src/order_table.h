@@ -0,0 +1,142 @@
+#pragma once
+
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+// Order IDs are short ASCII strings (5 characters at the fixed order-ID column,
+// e.g. "g01Ot"), so they fit into a single integer
+using OrderKey = uint64_t;
+
+// Pack an order ID of up to 7 characters into an OrderKey. The characters fill
+// the low bytes and length + 1 goes into the top byte, hence a packed ID is never
+// 0 (see OrderTable) and IDs of different lengths never collide. Longer IDs keep
+// their first 7 characters.
+//
+// For example, packOrderId("g01Ot") == 0x0600'0074'4f31'3067
+OrderKey packOrderId(std::string_view id) {
+    size_t len = id.size() < 7 ? id.size() : 7;
+    OrderKey key = static_cast<OrderKey>(len + 1) << 56;
+    for (size_t i = 0; i < len; ++i) {
+        key |= static_cast<OrderKey>(static_cast<unsigned char>(id[i])) << (8 * i);
+    }
+    return key;
+}
+
+// Active orders keyed by packed order ID (<orderId, qty>).
+//
+// Open addressing with linear probing over a single contiguous array of slots,
+// so a lookup is a multiply, a shift and usually one cache line. Deletion shifts
+// the following entries of the probe sequence back instead of leaving tombstones,
+// which keeps probe sequences short no matter how many orders come and go in a day.
+// The table doubles when it becomes more than half full; reserve() up front for
+// the expected number of simultaneously active orders to avoid rehashing.
+class OrderTable {
+public:
+    explicit OrderTable(size_t expectedOrders = 0) { reserve(expectedOrders); }
+
+    // make room for <expectedOrders> entries without rehashing
+    void reserve(size_t expectedOrders) {
+        size_t capacity = MIN_CAPACITY;
+        while (capacity < expectedOrders * 2) {
+            capacity *= 2;
+        }
+        if (capacity > slots_.size())
+            rehash(capacity);
+    }
+
+    // inserts <key> with <qty>, returns false (and leaves the entry alone) if the key is already present
+    bool insert(OrderKey key, int qty) {
+        if ((size_ + 1) * 2 > slots_.size())
+            rehash(slots_.size() * 2);
+        size_t i = slotOf(key);
+        while (slots_[i].key != EMPTY) {
+            if (slots_[i].key == key)
+                return false;
+            i = (i + 1) & mask_;
+        }
+        slots_[i] = Entry{key, qty};
+        ++size_;
+        return true;
+    }
+
+    // returns a pointer to the qty of <key>, nullptr if not present. The pointer is
+    // invalidated by the next insert() or erase()
+    int* find(OrderKey key) {
+        size_t i = slotOf(key);
+        while (slots_[i].key != EMPTY) {
+            if (slots_[i].key == key)
+                return &slots_[i].qty;
+            i = (i + 1) & mask_;
+        }
+        return nullptr;
+    }
+
+    // removes <key>, returns false if it was not present
+    bool erase(OrderKey key) {
+        size_t i = slotOf(key);
+        while (slots_[i].key != key) {
+            if (slots_[i].key == EMPTY)
+                return false;
+            i = (i + 1) & mask_;
+        }
+        // backward shift: move every following entry that may not sit before its home slot into the hole
+        size_t hole = i;
+        for (size_t j = (i + 1) & mask_; slots_[j].key != EMPTY; j = (j + 1) & mask_) {
+            size_t home = slotOf(slots_[j].key);
+            if (((j - home) & mask_) >= ((j - hole) & mask_)) {
+                slots_[hole] = slots_[j];
+                hole = j;
+            }
+        }
+        slots_[hole].key = EMPTY;
+        --size_;
+        return true;
+    }
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    size_t capacity() const { return slots_.size(); }
+
+    void clear() {
+        for (auto& slot : slots_) {
+            slot.key = EMPTY;
+        }
+        size_ = 0;
+    }
+
+private:
+    struct Entry {
+        OrderKey key; // EMPTY marks a free slot
+        int qty;
+    };
+
+    static constexpr OrderKey EMPTY = 0;
+    static constexpr size_t MIN_CAPACITY = 16;
+
+    std::vector<Entry> slots_;
+    size_t size_ = 0;
+    size_t mask_ = 0;
+    unsigned shift_ = 64;
+
+    // Fibonacci hashing, the top bits of key * 2^64/phi spread neighbouring IDs over the table
+    size_t slotOf(OrderKey key) const {
+        return static_cast<size_t>((key * 0x9E3779B97F4A7C15ull) >> shift_);
+    }
+
+    void rehash(size_t capacity) {
+        std::vector<Entry> old;
+        old.swap(slots_);
+        slots_.assign(capacity, Entry{EMPTY, 0});
+        mask_ = capacity - 1;
+        shift_ = 64;
+        for (size_t c = capacity; c > 1; c >>= 1) {
+            --shift_;
+        }
+        size_ = 0;
+        for (const auto& entry : old) {
+            if (entry.key != EMPTY)
+                insert(entry.key, entry.qty);
+        }
+    }
+};
@@ -0,0 +1,506 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+#include <cctype>
+#include <atomic>
+#include <thread>
+#include <filesystem>
+#include <iterator>
+#include <memory>
+
+#include "alloc_counter.h"
+#include "calc.h"
+#include "event_cache.h"
+#include "event_parser.h"
+#include "follow_log.h"
+#include "gzip_log.h"
+#include "log_filter.h"
+#include "log_reader.h"
+#include "log_stats.h"
+#include "order_replay.h"
+#include "run_metrics.h"
+#include "symbol_table.h"
+#include "warning_log.h"
+
+// Settings that apply to every log processed in one run
+struct CalcOptions {
+    bool verbose = false;
+    std::vector<TimeOfDay> intervals = {30 * MICROS_PER_SECOND}; // time between check points, one set of stats per interval
+    std::vector<double> percentiles = {50, 90, 99, 99.9}; // tail percentiles reported on top of the median
+    size_t expectedOrders = 4096; // simultaneously active orders to reserve room for
+    size_t topSymbols = 10; // symbols with the highest peak amount to report per interval, 0 to not track symbols
+    bool filterLog = false; // apply <filter> to every entry, for raw (un-grepped) logs
+    LogFilter filter;       // with more than one strategy prefix, stats are kept per strategy
+    bool follow = false; // tail a log that is still being written, emitting every sample as its check point passes
+    bool writeCache = false; // write the events of every text log read to its event cache (see event_cache.h)
+    bool storeSeries = false; // store the state at every check point too, not only the stats over them
+    size_t jobs = 1; // threads parsing a single mapped log, the replay itself is always sequential
+    WarningLog* warnings = nullptr; // where the problems with entries are reported, shared by every log of the run
+};
+
+// Set by SIGINT/SIGTERM to end --follow early, the stats gathered so far are still written
+std::atomic<bool> stopFollowing{false};
+
+void requestStopFollowing(int)
+{
+    stopFollowing = true;
+}
+
+// The window of the trading day that is sampled, every interval checks the same window
+const TimeOfDay FIRST_CHECK_TIME = parseTimeOfDay("09:10:00").value();
+const TimeOfDay LAST_CHECK_TIME = parseTimeOfDay("13:24:50").value();
+
+// Returns true if the stats are kept apart for each strategy prefix given with -p
+bool partitionByStrategy(const CalcOptions& options)
+{
+    return options.filterLog && options.filter.strategyPrefixes.size() > 1;
+}
+
+// Reads the entries of the log <filename> as <options> say
+EventParser makeParser(const std::string& filename, const CalcOptions& options)
+{
+    // the cache always records symbols, a later replay may want them
+    return EventParser(filename, options.filterLog ? &options.filter : nullptr, partitionByStrategy(options),
+        options.topSymbols > 0 || options.writeCache);
+}
+
+// Active order replay, one per strategy, sampled at the check points of every interval in <options>
+StrategyReplay makeReplay(const CalcOptions& options)
+{
+    size_t strategies = partitionByStrategy(options) ? options.filter.strategyPrefixes.size() : 1;
+    StrategyReplay replay(strategies, FIRST_CHECK_TIME, LAST_CHECK_TIME, options.intervals, options.expectedOrders);
+    if (options.verbose || options.follow) {
+        replay.setTrace(&std::cout, partitionByStrategy(options) ? options.filter.strategyPrefixes : std::vector<std::string>());
+    }
+    return replay;
+}
+
+// The <n> symbols with the highest peak amount over the check points of <series>,
+// highest first
+//
+// Arguments:
+//      <names> are the names of the symbol indexes, see SymbolTable
+std::vector<TopSymbol> topSymbols(const CheckPointSeries& series, const std::vector<std::string>& names, size_t n)
+{
+    const std::vector<SymbolPeak>& peaks = series.symbolPeaks();
+    std::vector<uint32_t> exposed;
+    for (uint32_t symbol = 0; symbol < peaks.size(); ++symbol) {
+        if (peaks[symbol].amount > 0)
+            exposed.push_back(symbol);
+    }
+    n = std::min(n, exposed.size());
+    std::partial_sort(exposed.begin(), exposed.begin() + n, exposed.end(), [&](uint32_t a, uint32_t b) {
+        return peaks[a].amount != peaks[b].amount ? peaks[a].amount > peaks[b].amount : names[a] < names[b];
+    });
+    std::vector<TopSymbol> top;
+    for (size_t i = 0; i < n; ++i) {
+        const SymbolPeak& peak = peaks[exposed[i]];
+        top.push_back(TopSymbol{names[exposed[i]], peak.amount, formatTimeOfDay(peak.time), peak.activeOrders});
+    }
+    return top;
+}
+
+// Stats of a finished replay of the log <filename>, one per strategy and interval
+//
+// Arguments:
+//      <symbolNames> are the names of the symbol indexes of the events replayed
+std::vector<LogStats> replayStats(const StrategyReplay& replay, const std::string& filename, const CalcOptions& options,
+    const std::vector<std::string>& symbolNames)
+{
+    std::vector<LogStats> stats;
+    for (size_t s = 0; s < replay.strategyCount(); ++s) {
+        const OrderReplay& strategy = replay.strategy(s);
+        for (size_t i = 0; i < strategy.seriesCount(); ++i) {
+            const CheckPointSeries& series = strategy.series(i);
+            stats.push_back(computeStats(filename, series.samples(), strategy.count(), series.interval(), options.percentiles));
+            stats.back().activeOrdersHistogram = series.activeOrdersHistogram().serialize();
+            stats.back().amountHistogram = series.amountHistogram().serialize();
+            stats.back().topSymbols = topSymbols(series, symbolNames, options.topSymbols);
+            if (options.storeSeries) {
+                std::vector<CheckPointSample>& samples = stats.back().series;
+                samples.reserve(series.samples().size());
+                for (size_t c = 0; c < series.samples().size(); ++c) {
+                    samples.push_back(CheckPointSample{static_cast<double>(series.checkTimes()[c]) / MICROS_PER_SECOND,
+                        series.samples()[c].first, series.samples()[c].second});
+                }
+            }
+            if (partitionByStrategy(options))
+                stats.back().strategy = options.filter.strategyPrefixes[s];
+        }
+    }
+    return stats;
+}
+
+// Strategy filter a log is read with, as recorded in its event cache, e.g. "C70,C71"
+std::string cacheStrategies(const CalcOptions& options)
+{
+    std::string strategies;
+    for (size_t i = 0; options.filterLog && i < options.filter.strategyPrefixes.size(); ++i) {
+        strategies += (i > 0 ? "," : "") + options.filter.strategyPrefixes[i];
+    }
+    return strategies;
+}
+
+// Replays the lines of <inputLog> (a MappedLog, GzipLog or FollowLog) through the
+// active order state machine, samples it at the check points of every interval and
+// returns the resulting stats, one per strategy and interval (none if the log cannot be opened).
+// Only touches its own state, so several logs can be processed concurrently.
+//
+// With options.writeCache the events are also written to the event cache of the
+// log. The cache then holds every event up to the first one past the last check
+// point, which is all a replay at any interval needs.
+//
+// The time spent and what was read go to <metrics>.
+template <typename LogReader>
+std::vector<LogStats> replayLog(LogReader& inputLog, const std::string& filename, const CalcOptions& options, RunMetrics& metrics)
+{
+    if (!inputLog.isOpen())
+    {
+        std::cerr << "Failed to open log (filename from user input = " << filename << std::endl;
+        return {};
+    }
+    StrategyReplay replay = makeReplay(options);
+    EventParser parser = makeParser(filename, options);
+    std::string_view line; // points into the reader's buffer, never copied
+    OrderEvent event;
+    EventCacheWriter cache;
+    bool caching = options.writeCache;
+    LoopTimer loopTimer(metrics);
+#if defined(CALC_COUNT_ALLOCATIONS)
+    const size_t warmUpLines = 10000; // long enough for the order table and symbols to settle
+    size_t lines = 0;
+    size_t warmAllocations = 0;
+#endif
+
+    while (!replay.done() || caching) {
+        loopTimer.startParse();
+        if (!inputLog.nextLine(line))
+            break;
+#if defined(CALC_COUNT_ALLOCATIONS)
+        if (++lines == warmUpLines)
+            warmAllocations = allocationCount();
+#endif
+        if (options.follow && line.empty()) {
+            // the log is quiet, check points still pass by the clock
+            TimeOfDay now = currentTimeOfDay();
+            loopTimer.startReplay();
+            replay.advanceTo(now);
+            loopTimer.endReplay();
+            caching = caching && now <= LAST_CHECK_TIME;
+            continue;
+        }
+        if (!parser.read(line, event, *options.warnings))
+            continue;
+        if (caching) {
+            cache.append(event);
+            caching = event.time <= LAST_CHECK_TIME;
+        }
+        // this log entry is past the check point(s), record the state as it was at each of them
+        loopTimer.startReplay();
+        replay.advanceTo(event.time);
+        if (!replay.done())
+            replay.apply(event);
+        loopTimer.endReplay();
+    }
+    loopTimer.stop();
+    if (options.follow) {
+        // stopped early, the check points that went by since the last entry still saw the current state
+        replay.advanceTo(currentTimeOfDay());
+    }
+#if defined(CALC_COUNT_ALLOCATIONS)
+    if (lines > warmUpLines) {
+        // the event cache grows with the log, so --write-cache is not expected to stay at 0
+        std::cout << "[DEBUG] " << filename << ": " << allocationCount() - warmAllocations << " heap allocations in the " <<
+            lines - warmUpLines << " lines after the first " << warmUpLines << std::endl;
+    }
+#endif
+    if (options.writeCache && !cache.write(eventCachePath(filename), cacheStrategies(options), parser.symbols().names())) {
+        options.warnings->print("[WARN] failed to write event cache " + eventCachePath(filename));
+    }
+    metrics.counters = parser.counters();
+    metrics.events = parser.counters().events;
+    metrics.peakActiveOrders = replay.peakActiveOrders();
+    PhaseTimer statsTimer(metrics, Phase::Stats);
+    return replayStats(replay, filename, options, parser.symbols().names());
+}
+
+// The events of a piece of a log, parsed independently of the other pieces
+struct ParsedChunk {
+    std::vector<OrderEvent> events;
+    SymbolTable symbols;   // the symbol indexes of the events are local to the chunk
+    std::unique_ptr<ChunkWarnings> warnings; // reported while parsing, passed on to the WarningLog as the events are replayed
+    bool pastLastCheck = false; // holds an event past LAST_CHECK_TIME, so no later chunk is ever replayed
+    ParseCounters counters;
+};
+
+void parseChunk(std::string_view text, const std::string& filename, const CalcOptions& options, ParsedChunk& chunk)
+{
+    chunk.warnings = std::make_unique<ChunkWarnings>(*options.warnings);
+    EventParser parser = makeParser(filename, options);
+    OrderEvent event;
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t eol = text.find('\n', pos);
+        size_t len = (eol == std::string_view::npos ? text.size() : eol) - pos;
+        std::string_view line = text.substr(pos, len);
+        pos += len + 1;
+        chunk.warnings->setEvent(chunk.events.size());
+        if (!parser.read(line, event, *chunk.warnings))
+            continue;
+        chunk.events.push_back(event);
+        chunk.pastLastCheck = chunk.pastLastCheck || event.time > LAST_CHECK_TIME;
+    }
+    chunk.symbols = parser.symbols();
+    chunk.counters = parser.counters();
+}
+
+// Same as replayLog(), but the parsing (which dominates) is spread over
+// options.jobs threads: the mapped log is split into line-aligned chunks that are
+// parsed into OrderEvents in parallel, then the events are replayed in log order.
+// Warnings are held back and reported in between the events exactly where
+// replayLog() would report them, so what the WarningLog prints does not depend
+// on the number of threads. Chunks after the first one that reaches past the last check point are
+// not parsed at all; the counters in <metrics> cover every chunk that was.
+std::vector<LogStats> replayLogParallel(MappedLog& inputLog, const std::string& filename, const CalcOptions& options, RunMetrics& metrics)
+{
+    if (!inputLog.isOpen())
+    {
+        std::cerr << "Failed to open log (filename from user input = " << filename << std::endl;
+        return {};
+    }
+    // a few chunks per thread, so a thread finishing early picks up more work
+    std::vector<std::string_view> pieces = splitLines(std::string_view(inputLog.data(), inputLog.size()), options.jobs * 4);
+    std::vector<ParsedChunk> chunks(pieces.size());
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> lastNeeded{pieces.size()};
+    std::vector<std::thread> workers;
+    PhaseTimer parseTimer(metrics, Phase::Parse);
+    for (size_t i = 0; i < std::min(options.jobs, pieces.size()); ++i) {
+        workers.emplace_back([&]() {
+            for (size_t c = next++; c < pieces.size() && c <= lastNeeded; c = next++) {
+                parseChunk(pieces[c], filename, options, chunks[c]);
+                size_t needed = lastNeeded;
+                while (chunks[c].pastLastCheck && c < needed && !lastNeeded.compare_exchange_weak(needed, c)) {
+                }
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    parseTimer.stop();
+
+    PhaseTimer replayTimer(metrics, Phase::Replay);
+    StrategyReplay replay = makeReplay(options);
+    SymbolTable symbols;
+    EventCacheWriter cache;
+    bool caching = options.writeCache;
+    for (size_t c = 0; c < chunks.size() && (!replay.done() || caching); ++c) {
+        ParsedChunk& chunk = chunks[c];
+        std::vector<uint32_t> globalSymbols; // chunks are merged in log order, so symbols are numbered as replayLog() does
+        for (const auto& name : chunk.symbols.names()) {
+            globalSymbols.push_back(symbols.intern(name));
+        }
+        const std::vector<ChunkWarnings::Held>& held = chunk.warnings->held();
+        size_t reported = 0;
+        std::array<uint64_t, Warning::Count> skipped{}; // passed on so far, of the warnings not held
+        auto reportWarnings = [&](size_t upTo) {
+            for (; reported < held.size() && held[reported].event <= upTo; ++reported) {
+                const ChunkWarnings::Held& warning = held[reported];
+                options.warnings->skip(warning.kind, warning.skipped);
+                skipped[warning.kind] += warning.skipped;
+                options.warnings->warn(warning.kind, filename, warning.line, warning.field);
+            }
+        };
+        size_t i = 0;
+        for (; i < chunk.events.size() && (!replay.done() || caching); ++i) {
+            reportWarnings(i);
+            OrderEvent& event = chunk.events[i];
+            if (event.symbol != SymbolTable::NO_SYMBOL)
+                event.symbol = globalSymbols[event.symbol];
+            if (caching) {
+                cache.append(event);
+                caching = event.time <= LAST_CHECK_TIME;
+            }
+            replay.advanceTo(event.time);
+            if (!replay.done())
+                replay.apply(event);
+        }
+        // replayLog() would have read up to the event the replay stopped at, or on to the end of the chunk
+        size_t reached = !replay.done() || caching ? chunk.events.size() : i - 1;
+        reportWarnings(reached);
+        for (size_t kind = 0; kind < Warning::Count; ++kind) {
+            options.warnings->skip(kind, chunk.warnings->skippedUpTo(kind, reached) - skipped[kind]);
+        }
+    }
+    replayTimer.stop();
+    if (options.writeCache && !cache.write(eventCachePath(filename), cacheStrategies(options), symbols.names())) {
+        options.warnings->print("[WARN] failed to write event cache " + eventCachePath(filename));
+    }
+    for (const auto& chunk : chunks) {
+        metrics.counters.merge(chunk.counters);
+    }
+    metrics.events = metrics.counters.events;
+    metrics.peakActiveOrders = replay.peakActiveOrders();
+    PhaseTimer statsTimer(metrics, Phase::Stats);
+    return replayStats(replay, filename, options, symbols.names());
+}
+
+// Replays the events cached in <path> instead of parsing the text log again. In
+// <metrics>, the time to read an event from the cache is the parse time.
+std::vector<LogStats> replayEventCache(const std::string& path, const CalcOptions& options, RunMetrics& metrics)
+{
+    PhaseTimer openTimer(metrics, Phase::Open);
+    EventCache cache(path);
+    openTimer.stop();
+    if (!cache.isOpen()) {
+        std::cerr << "Failed to open event cache " << path << std::endl;
+        return {};
+    }
+    if (cache.strategies() != cacheStrategies(options)) {
+        std::cerr << "Event cache " << path << " was built with strategy filter '" << cache.strategies() <<
+            "', rebuild it from the log with the same -p" << std::endl;
+        return {};
+    }
+    StrategyReplay replay = makeReplay(options);
+    LoopTimer loopTimer(metrics);
+    for (size_t i = 0; i < cache.size() && !replay.done(); ++i) {
+        loopTimer.startParse();
+        OrderEvent event = cache.event(i);
+        if (options.topSymbols == 0)
+            event.symbol = SymbolTable::NO_SYMBOL;
+        metrics.events += event.status != OrderEvent::CLOCK_ONLY;
+        loopTimer.startReplay();
+        replay.advanceTo(event.time);
+        if (!replay.done())
+            replay.apply(event);
+        loopTimer.endReplay();
+    }
+    loopTimer.stop();
+    metrics.peakActiveOrders = replay.peakActiveOrders();
+    PhaseTimer statsTimer(metrics, Phase::Stats);
+    return replayStats(replay, path, options, cache.symbolNames());
+}
+
+// Returns true if <logPath> has an event cache that is newer than the log and
+// was built with the current strategy filter
+bool hasUsableEventCache(const std::string& logPath, const CalcOptions& options)
+{
+    std::string cachePath = eventCachePath(logPath);
+    std::error_code ec;
+    auto cacheTime = std::filesystem::last_write_time(cachePath, ec);
+    if (ec || cacheTime < std::filesystem::last_write_time(logPath, ec) || ec)
+        return false;
+    EventCache cache(cachePath);
+    return cache.isOpen() && cache.strategies() == cacheStrategies(options);
+}
+
+// Processes a single log into one set of stats per strategy and interval (none on error): event
+// caches (*.evc) are replayed directly, gzip-compressed logs are streamed through
+// GzipLog instead of being mapped, and a log that is still being written is followed.
+// <metrics> receives the metrics of the log.
+std::vector<LogStats> processLog(const std::string& filename, const CalcOptions& options, RunMetrics& metrics)
+{
+    metrics.log = filename;
+    if (isEventCachePath(filename)) {
+        return replayEventCache(filename, options, metrics);
+    }
+    PhaseTimer openTimer(metrics, Phase::Open);
+    if (options.follow) {
+        FollowLog inputLog(filename, &stopFollowing);
+        openTimer.stop();
+        return replayLog(inputLog, filename, options, metrics);
+    }
+    if (isGzipPath(filename)) {
+        GzipLog inputLog(filename);
+        openTimer.stop();
+        std::vector<LogStats> stats = replayLog(inputLog, filename, options, metrics);
+        if (inputLog.failed()) {
+            options.warnings->print("[WARN] failed to decompress " + filename + " (" + inputLog.error() + "), stats only cover the lines read before");
+        }
+        return stats;
+    }
+    MappedLog inputLog(filename);
+    openTimer.stop();
+    if (options.jobs > 1) {
+        return replayLogParallel(inputLog, filename, options, metrics);
+    }
+    return replayLog(inputLog, filename, options, metrics);
+}
+
+// Returns true if <path> is named like a daily log, i.e. YYYYMMDD.<ext> or YYYYMMDD.<ext>.gz
+bool isDailyLog(const std::filesystem::path& path)
+{
+    std::filesystem::path name = path.extension() == ".gz" ? path.stem() : path.filename();
+    std::string stem = name.stem().string();
+    return stem.size() == 8 && name.has_extension() &&
+        std::all_of(stem.begin(), stem.end(), [](unsigned char c) { return std::isdigit(c); });
+}
+
+// Returns the daily logs (see isDailyLog()) in <dir>, ordered by file name, which
+// orders them by date
+std::vector<std::string> dailyLogs(const std::string& dir)
+{
+    std::vector<std::string> files;
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(dir, ec)) {
+        if (entry.is_regular_file() && isDailyLog(entry.path())) {
+            files.push_back(entry.path().string());
+        }
+    }
+    if (ec) {
+        std::cerr << "Failed to read log directory " << dir << ": " << ec.message() << std::endl;
+    }
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+// Parse threads (-j) of each log when <workers> logs are processed at once: the
+// <jobs> are shared out among them, at least one each
+size_t jobsPerLog(size_t jobs, size_t workers)
+{
+    return std::max<size_t>(1, jobs / std::max<size_t>(1, workers));
+}
+
+// Processes every daily log in <dir> on a pool of worker threads (one per core)
+// and returns the stats of the logs that could be processed, ordered by file name
+// (and strategy and interval), and the metrics of every log in <metrics>, in the same order.
+// A log with an up-to-date event cache is replayed from the cache instead.
+// The options.jobs parse threads are shared out among the workers, so -j does
+// not multiply the threads, nor the logs held in memory at once, by the workers.
+std::vector<LogStats> processLogDir(const std::string& dir, const CalcOptions& options, std::vector<RunMetrics>& metrics)
+{
+    std::vector<std::string> files = dailyLogs(dir);
+    std::vector<std::vector<LogStats>> results(files.size());
+    metrics.assign(files.size(), RunMetrics());
+    std::atomic<size_t> next{0};
+    size_t numWorkers = std::max(1u, std::thread::hardware_concurrency());
+    numWorkers = std::min(numWorkers, files.size());
+    CalcOptions logOptions = options;
+    logOptions.jobs = jobsPerLog(options.jobs, numWorkers);
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < numWorkers; ++i) {
+        workers.emplace_back([&]() {
+            for (size_t f = next++; f < files.size(); f = next++) {
+                if (hasUsableEventCache(files[f], logOptions)) {
+                    results[f] = processLog(eventCachePath(files[f]), logOptions, metrics[f]);
+                } else {
+                    results[f] = processLog(files[f], logOptions, metrics[f]);
+                }
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    std::vector<LogStats> stats;
+    for (auto& result : results) {
+        std::move(result.begin(), result.end(), std::back_inserter(stats));
+    }
+    return stats;
+}
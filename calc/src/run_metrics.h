@@ -0,0 +1,353 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <cstdio>
+#include <cstdint>
+
+#include <sqlite3.h>
+
+#include "event_parser.h"
+#include "write2db.h"
+
+// Index of each timed phase of a run, e.g. metrics.phaseNanos[Phase::Parse]
+struct Phase {
+    enum : size_t {
+        Open,   // opening (mapping, decompressing the header of) the log
+        Parse,  // reading entries into OrderEvents
+        Replay, // feeding the events through the active order state machine
+        Stats,  // computing the stats over the check points
+        Write,  // storing the stats of the whole run, see write2db()
+        Count
+    };
+};
+
+const char* const PHASE_NAMES[Phase::Count] = {"open", "parse", "replay", "stats", "write"};
+
+using MetricsClock = std::chrono::steady_clock; // monotonic, wall clock adjustments do not skew the phases
+
+int64_t nanosSince(MetricsClock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(MetricsClock::now() - start).count();
+}
+
+// Where the time of processing a log went and what was in it
+struct RunMetrics {
+    std::string log; // the log (or event cache) processed, empty for the total of a run
+    std::array<int64_t, Phase::Count> phaseNanos{};
+    ParseCounters counters;      // lines, bytes, warnings... of the text log, all 0 for an event cache
+    uint64_t events = 0;         // order updates read, from the log or its event cache
+    size_t peakActiveOrders = 0; // high-water mark of the order table, see OrderReplay::peakActiveOrders()
+
+    int64_t totalNanos() const {
+        int64_t total = 0;
+        for (int64_t nanos : phaseNanos) {
+            total += nanos;
+        }
+        return total;
+    }
+
+    // adds up the work of <other>, the peak is the higher of the two
+    void merge(const RunMetrics& other) {
+        for (size_t i = 0; i < phaseNanos.size(); ++i) {
+            phaseNanos[i] += other.phaseNanos[i];
+        }
+        counters.merge(other.counters);
+        events += other.events;
+        peakActiveOrders = std::max(peakActiveOrders, other.peakActiveOrders);
+    }
+};
+
+// Adds the time from its construction to stop() (or its destruction) to one phase
+//
+// For example:
+//      {
+//          PhaseTimer timer(metrics, Phase::Stats);
+//          stats = replayStats(...);
+//      }
+class PhaseTimer {
+public:
+    PhaseTimer(RunMetrics& metrics, size_t phase) : metrics_(metrics), phase_(phase), start_(MetricsClock::now()) {}
+    ~PhaseTimer() { stop(); }
+
+    PhaseTimer(const PhaseTimer&) = delete;
+    PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+    void stop() {
+        if (running_)
+            metrics_.phaseNanos[phase_] += nanosSince(start_);
+        running_ = false;
+    }
+
+private:
+    RunMetrics& metrics_;
+    size_t phase_;
+    MetricsClock::time_point start_;
+    bool running_ = true;
+};
+
+// Passes through a loop between two that are timed, see LoopTimer
+const uint64_t PHASE_SAMPLE_EVENTS = 64;
+
+// Least time between two back-to-back clock reads, what reading the clock adds to
+// a timed stretch of code; measured once per process
+int64_t clockReadNanos() {
+    static const int64_t nanos = [] {
+        int64_t least = INT64_MAX;
+        for (int i = 0; i < 32; ++i) {
+            MetricsClock::time_point start = MetricsClock::now();
+            least = std::min(least, nanosSince(start));
+        }
+        return least;
+    }();
+    return nanos;
+}
+
+// Splits the time of a loop that reads and replays one event at a time between
+// Phase::Parse and Phase::Replay. Reading the clock around every event would
+// cost about as much as replaying it, so only every PHASE_SAMPLE_EVENTS-th pass
+// is timed, its read and its replay alike, each less the cost of a clock read.
+// Scaled up to all reads and replays, the two sampled times split the time of
+// the whole loop between the phases.
+//
+// For example:
+//      LoopTimer timer(metrics);
+//      while (true) {
+//          timer.startParse();
+//          if (!read(event))
+//              break;
+//          timer.startReplay();
+//          replay.apply(event);
+//          timer.endReplay();
+//      }
+class LoopTimer {
+public:
+    explicit LoopTimer(RunMetrics& metrics) : metrics_(metrics), clockNanos_(clockReadNanos()), start_(MetricsClock::now()) {}
+    ~LoopTimer() { stop(); }
+
+    LoopTimer(const LoopTimer&) = delete;
+    LoopTimer& operator=(const LoopTimer&) = delete;
+
+    // a pass through the loop starts by reading the next event (or line)
+    void startParse() {
+        if (parsing_) {
+            // the sampled pass read no event
+            parseNanos_ += sampleSince(MetricsClock::now());
+            ++parseSamples_;
+            parsing_ = false;
+        }
+        if (++parses_ % PHASE_SAMPLE_EVENTS == 0) {
+            parsing_ = true;
+            sampleStart_ = MetricsClock::now();
+        }
+    }
+
+    // ends the read of the pass, its event is replayed next
+    void startReplay() {
+        ++replays_;
+        if (!parsing_)
+            return;
+        MetricsClock::time_point now = MetricsClock::now();
+        parseNanos_ += sampleSince(now);
+        ++parseSamples_;
+        parsing_ = false;
+        replaying_ = true;
+        sampleStart_ = now;
+    }
+
+    void endReplay() {
+        if (!replaying_)
+            return;
+        replayNanos_ += sampleSince(MetricsClock::now());
+        ++replaySamples_;
+        replaying_ = false;
+    }
+
+    void stop() {
+        if (!running_)
+            return;
+        running_ = false;
+        int64_t total = nanosSince(start_);
+        double parse = parseSamples_ > 0 ? static_cast<double>(parseNanos_) / parseSamples_ * parses_ : 0;
+        double replay = replaySamples_ > 0 ? static_cast<double>(replayNanos_) / replaySamples_ * replays_ : 0;
+        int64_t replayShare = parse + replay > 0 ? static_cast<int64_t>(total * (replay / (parse + replay))) : 0;
+        metrics_.phaseNanos[Phase::Parse] += total - replayShare;
+        metrics_.phaseNanos[Phase::Replay] += replayShare;
+    }
+
+private:
+    RunMetrics& metrics_;
+    int64_t clockNanos_;
+    MetricsClock::time_point start_;
+    MetricsClock::time_point sampleStart_;
+    uint64_t parses_ = 0;
+    uint64_t replays_ = 0;
+    uint64_t parseSamples_ = 0;
+    uint64_t replaySamples_ = 0;
+    int64_t parseNanos_ = 0;
+    int64_t replayNanos_ = 0;
+    bool parsing_ = false;   // the read of a sampled pass is being timed
+    bool replaying_ = false; // the replay of a sampled pass is being timed
+    bool running_ = true;
+
+    int64_t sampleSince(MetricsClock::time_point now) const {
+        return std::max<int64_t>(0, std::chrono::duration_cast<std::chrono::nanoseconds>(now - sampleStart_).count() - clockNanos_);
+    }
+};
+
+// Local time as YYYY-MM-DD HH:MM:SS.mmm, when a run started. With the
+// milliseconds two runs in a row still get rows of their own in run_metrics.
+std::string formatRunTime(std::chrono::system_clock::time_point time) {
+    std::time_t seconds = std::chrono::system_clock::to_time_t(time);
+    int millis = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count() % 1000);
+    std::tm local{};
+    localtime_r(&seconds, &local);
+    char buffer[32];
+    size_t length = std::strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", &local);
+    snprintf(buffer + length, sizeof(buffer) - length, ".%03d", millis);
+    return buffer;
+}
+
+// <text> as a JSON string literal
+std::string jsonString(const std::string& text) {
+    std::string quoted = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+            quoted += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            quoted += escaped;
+        } else {
+            quoted += c;
+        }
+    }
+    return quoted + "\"";
+}
+
+// <metrics> as a JSON object, indented by <indent>
+std::string runMetricsJson(const RunMetrics& metrics, const std::string& indent) {
+    double seconds = static_cast<double>(metrics.totalNanos()) / 1e9;
+    std::string json = "{\n";
+    if (!metrics.log.empty())
+        json += indent + "  \"log\": " + jsonString(metrics.log) + ",\n";
+    json += indent + "  \"seconds\": {";
+    for (size_t i = 0; i < Phase::Count; ++i) {
+        char value[32];
+        snprintf(value, sizeof(value), "%.6f", static_cast<double>(metrics.phaseNanos[i]) / 1e9);
+        json += std::string(i > 0 ? ", " : "") + "\"" + PHASE_NAMES[i] + "\": " + value;
+    }
+    json += "},\n";
+    char rates[96];
+    snprintf(rates, sizeof(rates), "\"bytesPerSecond\": %.0f, \"linesPerSecond\": %.0f",
+        seconds > 0 ? static_cast<double>(metrics.counters.bytes) / seconds : 0.0,
+        seconds > 0 ? static_cast<double>(metrics.counters.lines) / seconds : 0.0);
+    json += indent + "  \"bytes\": " + std::to_string(metrics.counters.bytes) + ", \"lines\": " + std::to_string(metrics.counters.lines) + ", " + rates + ",\n";
+    json += indent + "  \"skippedLines\": " + std::to_string(metrics.counters.skipped) + ", \"filteredLines\": " + std::to_string(metrics.counters.filtered) +
+        ", \"events\": " + std::to_string(metrics.events) + ",\n";
+    json += indent + "  \"warnings\": {";
+    for (size_t i = 0; i < Warning::Count; ++i) {
+        json += std::string(i > 0 ? ", " : "") + "\"" + WARNING_NAMES[i] + "\": " + std::to_string(metrics.counters.warnings[i]);
+    }
+    json += "},\n";
+    json += indent + "  \"peakActiveOrders\": " + std::to_string(metrics.peakActiveOrders) + "\n";
+    return json + indent + "}";
+}
+
+// The JSON summary of a run: when it started, how long it took from start to
+// finish, the metrics of every log and their total. The phases of the logs add
+// up to more than the elapsed time when logs were processed in parallel (-d).
+std::string runMetricsJson(const std::string& runAt, double elapsedSeconds, const std::vector<RunMetrics>& logs, const RunMetrics& total) {
+    char elapsed[32];
+    snprintf(elapsed, sizeof(elapsed), "%.6f", elapsedSeconds);
+    std::string json = "{\n  \"runAt\": " + jsonString(runAt) + ",\n  \"elapsedSeconds\": " + elapsed + ",\n  \"logs\": [";
+    for (size_t i = 0; i < logs.size(); ++i) {
+        json += std::string(i > 0 ? ", " : "") + runMetricsJson(logs[i], "    ");
+    }
+    return json + "],\n  \"total\": " + runMetricsJson(total, "  ") + "\n}\n";
+}
+
+// SQL to create the run_metrics table if not already existent, one row per log
+// processed by a run
+std::string createRunMetricsTableSQL() {
+    std::string sql = R"(CREATE TABLE IF NOT EXISTS run_metrics
+           (runAt TEXT,
+            log TEXT,
+            elapsedSeconds REAL,
+            )";
+    for (size_t i = 0; i < Phase::Count; ++i) {
+        sql += std::string(PHASE_NAMES[i]) + "Seconds REAL,\n            ";
+    }
+    sql += "bytes INT,\n            lines INT,\n            skippedLines INT,\n            filteredLines INT,\n            events INT,\n            ";
+    for (size_t i = 0; i < Warning::Count; ++i) {
+        sql += std::string(WARNING_NAMES[i]) + "Warnings INT,\n            ";
+    }
+    return sql + "peakActiveOrders INT,\n            PRIMARY KEY (runAt, log))";
+}
+
+// SQL to insert (or replace) the row of a log of a run into the run_metrics table
+std::string insertRunMetricsSQL() {
+    std::string columns = "runAt, log, elapsedSeconds";
+    std::string values = "?, ?, ?";
+    for (size_t i = 0; i < Phase::Count; ++i) {
+        columns += std::string(", ") + PHASE_NAMES[i] + "Seconds";
+        values += ", ?";
+    }
+    columns += ", bytes, lines, skippedLines, filteredLines, events";
+    values += ", ?, ?, ?, ?, ?";
+    for (size_t i = 0; i < Warning::Count; ++i) {
+        columns += std::string(", ") + WARNING_NAMES[i] + "Warnings";
+        values += ", ?";
+    }
+    return "INSERT OR REPLACE INTO run_metrics (" + columns + ", peakActiveOrders) VALUES (" + values + ", ?)";
+}
+
+// Stores the metrics of every log of a run in the run_metrics table of
+// <outputDB>, all in one transaction of a LogStatsWriter. The run's write phase
+// and elapsed time are not known per log, every row of the run carries those of
+// the whole run.
+//
+// Arguments:
+//      <runAt> when the run started, see formatRunTime()
+//      <total> the total of the run, see runMetricsJson()
+//
+// Returns 0 on success, 1 (after reporting the error) on failure
+int writeRunMetrics(const std::string& runAt, double elapsedSeconds, const std::vector<RunMetrics>& logs, const RunMetrics& total,
+    const std::string& outputDB) {
+    LogStatsWriter writer(logs.size());
+    bool ok = writer.open(outputDB) && writer.exec(createRunMetricsTableSQL());
+    for (size_t l = 0; ok && l < logs.size(); ++l) {
+        const RunMetrics& metrics = logs[l];
+        ok = writer.insert(insertRunMetricsSQL(), [&](sqlite3_stmt* stmt) {
+            int cnt = 1;
+            sqlite3_bind_text(stmt, cnt++, runAt.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_text(stmt, cnt++, metrics.log.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_double(stmt, cnt++, elapsedSeconds);
+            for (size_t i = 0; i < Phase::Count; ++i) {
+                int64_t nanos = i == Phase::Write ? total.phaseNanos[i] : metrics.phaseNanos[i];
+                sqlite3_bind_double(stmt, cnt++, static_cast<double>(nanos) / 1e9);
+            }
+            sqlite3_bind_int64(stmt, cnt++, static_cast<sqlite3_int64>(metrics.counters.bytes));
+            sqlite3_bind_int64(stmt, cnt++, static_cast<sqlite3_int64>(metrics.counters.lines));
+            sqlite3_bind_int64(stmt, cnt++, static_cast<sqlite3_int64>(metrics.counters.skipped));
+            sqlite3_bind_int64(stmt, cnt++, static_cast<sqlite3_int64>(metrics.counters.filtered));
+            sqlite3_bind_int64(stmt, cnt++, static_cast<sqlite3_int64>(metrics.events));
+            for (size_t i = 0; i < Warning::Count; ++i) {
+                sqlite3_bind_int64(stmt, cnt++, static_cast<sqlite3_int64>(metrics.counters.warnings[i]));
+            }
+            sqlite3_bind_int64(stmt, cnt++, static_cast<sqlite3_int64>(metrics.peakActiveOrders));
+        });
+    }
+    if (!ok)
+        writer.rollback();
+    if (!writer.close() || !ok) {
+        std::cerr << writer.lastError() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+// Symbols (stock codes such as "5299") numbered densely in order of first
+// appearance, so per-symbol state can live in plain arrays indexed by symbol
+// instead of maps keyed by string.
+//
+// For example:
+//      SymbolTable symbols;
+//      symbols.intern("5299"); // 0
+//      symbols.intern("2615"); // 1
+//      symbols.intern("5299"); // 0
+//      symbols.name(1);        // "2615"
+class SymbolTable {
+public:
+    static constexpr uint32_t NO_SYMBOL = UINT32_MAX;
+
+    // index of <symbol>, numbering it if it is new
+    uint32_t intern(std::string_view symbol) {
+        auto it = indexes_.find(std::string(symbol)); // stock codes are short enough to stay in the small string buffer
+        if (it != indexes_.end())
+            return it->second;
+        uint32_t index = static_cast<uint32_t>(names_.size());
+        names_.emplace_back(symbol);
+        indexes_.emplace(names_.back(), index);
+        return index;
+    }
+
+    const std::string& name(uint32_t index) const { return names_[index]; }
+    const std::vector<std::string>& names() const { return names_; } // indexed by symbol
+    size_t size() const { return names_.size(); }
+
+private:
+    std::vector<std::string> names_;
+    std::unordered_map<std::string, uint32_t> indexes_;
+};
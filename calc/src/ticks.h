@@ -0,0 +1,57 @@
+#pragma once
+
+#include <string_view>
+#include <optional>
+#include <cstdint>
+
+// Fixed-point money: prices and order amounts are counted in hundredths (ticks)
+// of the currency unit in an int64, so summing price * shares over a whole day
+// is exact and gives the same total on every run, which a float/double
+// accumulator does not.
+using Ticks = int64_t;
+
+const Ticks TICKS_PER_UNIT = 100;
+
+// Parse a decimal price straight from the log text into ticks, rounding to the
+// nearest hundredth (half away from zero), e.g. "109.5" gives 10950 and
+// "63.805" gives 6381
+//
+// Returns nullopt if <text> is not a non-negative decimal number, or has more than
+// 16 integer digits (too large for Ticks)
+std::optional<Ticks> parsePriceTicks(std::string_view text) {
+    if (text.empty())
+        return std::nullopt;
+    Ticks ticks = 0;
+    size_t i = 0;
+    for (; i < text.size() && text[i] >= '0' && text[i] <= '9'; ++i) {
+        if (i == 16)
+            return std::nullopt; // 17 integer digits and more may overflow once scaled to ticks
+        ticks = ticks * 10 + (text[i] - '0');
+    }
+    bool hasDigits = i > 0;
+    ticks *= TICKS_PER_UNIT;
+    if (i < text.size() && text[i] == '.') {
+        ++i;
+        Ticks scale = TICKS_PER_UNIT / 10;
+        bool roundUp = false;
+        for (size_t digits = 0; i < text.size() && text[i] >= '0' && text[i] <= '9'; ++i, ++digits) {
+            hasDigits = true;
+            if (digits < 2) {
+                ticks += (text[i] - '0') * scale;
+                scale /= 10;
+            } else if (digits == 2) {
+                roundUp = text[i] >= '5';
+            }
+        }
+        if (roundUp)
+            ++ticks;
+    }
+    if (!hasDigits || i != text.size())
+        return std::nullopt;
+    return ticks;
+}
+
+// Convert ticks to currency units, only for output (display and database)
+double ticksToUnits(double ticks) {
+    return ticks / TICKS_PER_UNIT;
+}
@@ -0,0 +1,332 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <array>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <memory>
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+
+// Kinds of problems parseOrderEvent() reports, e.g. counters.warnings[Warning::MalformedPrice]
+struct Warning {
+    enum : size_t {
+        BadTimestamp,    // no valid timestamp, the entry is skipped
+        NoStatus,        // no "=Status" field
+        NoPrice,         // not a Buy entry, or no price after the side
+        MalformedPrice,
+        NoShares,        // no qty after the price
+        MalformedShares,
+        UnknownStatus,   // neither a new order, a cancel nor a match report
+        Count
+    };
+};
+
+// Names of the Warning kinds, as used in metrics (see run_metrics.h) and in the WarningLog summary
+const char* const WARNING_NAMES[Warning::Count] = {
+    "badTimestamp", "noStatus", "noPrice", "malformedPrice", "noShares", "malformedShares", "unknownStatus"};
+
+// The text of a warning as calc prints it, e.g.
+// "[WARN] malformed price '1x9.5' in line: 09:13:06.012430 11 [Trace]..."
+//
+// Arguments:
+//      <kind> of the warning, see Warning
+//      <filename> names the log the entry <line> is from
+//      <field> is the offending field (price or shares) for the malformed kinds, else ignored
+std::string formatWarning(size_t kind, std::string_view filename, std::string_view line, std::string_view field) {
+    std::string text = "[WARN] ";
+    switch (kind) {
+        case Warning::BadTimestamp:
+        case Warning::NoStatus:
+            text.append("parsing error in file ").append(filename).append(" line: ");
+            break;
+        case Warning::NoPrice:
+            text += "unable to find matching price in line: ";
+            break;
+        case Warning::MalformedPrice:
+            text.append("malformed price '").append(field).append("' in line: ");
+            break;
+        case Warning::NoShares:
+            text += "unable to find matching shares in line: ";
+            break;
+        case Warning::MalformedShares:
+            text.append("malformed shares '").append(field).append("' in line: ");
+            break;
+        default:
+            text += "unable to find matching status in line: ";
+            break;
+    }
+    return text.append(line);
+}
+
+// Where parseOrderEvent() reports the problems of an entry. <line> and <field>
+// are views into the entry, only valid during the call.
+class WarningSink {
+public:
+    virtual ~WarningSink() = default;
+    virtual void warn(size_t kind, std::string_view filename, std::string_view line, std::string_view field) = 0;
+};
+
+// Writes every warning to <out> right away, e.g. into an std::ostringstream
+class StreamWarnings : public WarningSink {
+public:
+    explicit StreamWarnings(std::ostream& out) : out_(out) {}
+
+    void warn(size_t kind, std::string_view filename, std::string_view line, std::string_view field) override {
+        out_ << formatWarning(kind, filename, line, field) << '\n';
+    }
+
+private:
+    std::ostream& out_;
+};
+
+// Synchronous warnings on standard output, where EventParser reports to unless told otherwise
+WarningSink& coutWarnings() {
+    static StreamWarnings warnings(std::cout);
+    return warnings;
+}
+
+// How much of each kind of warning a WarningLog prints
+struct WarningLimits {
+    uint64_t burst = 100;         // warnings of each kind printed in full, 0 to print every warning
+    uint64_t sampleEvery = 1000;  // of the warnings past the burst, about one in sampleEvery is printed, none if 0
+};
+
+// Warnings printed in the background, so a corrupted log with millions of bad
+// entries costs a counter increment per entry instead of a synchronous write.
+//
+// Each kind of warning gets its first <burst> warnings printed in full and after
+// that only a sample of about one in <sampleEvery>, picked by a hash of the
+// entry. The limits count warnings rather than time, so what is printed depends
+// only on the log, not on how fast it is read or by how many threads (-j).
+// summary() tells how many there were of each kind.
+//
+// The warnings to print are queued in a fixed ring of slots that reporting
+// threads fill without taking a lock (a bounded MPMC queue after D. Vyukov);
+// a background thread drains it in batches to <out>. Should the ring fill up,
+// reporting waits for room rather than dropping a warning that was meant to be
+// printed.
+//
+// For example:
+//      WarningLog warnings;
+//      EventParser parser(...);
+//      parser.read(line, event, warnings);
+//      ...
+//      warnings.close();
+//      std::cout << warnings.summary();
+class WarningLog : public WarningSink {
+public:
+    static constexpr size_t SLOT_TEXT = 1016; // a longer warning is cut short, see push()
+
+    explicit WarningLog(WarningLimits limits = {}, FILE* out = stdout, size_t capacity = 1024)
+        : limits_(limits), out_(out) {
+        size_t slots = 1;
+        while (slots < capacity) {
+            slots *= 2;
+        }
+        slots_.reset(new Slot[slots]);
+        mask_ = slots - 1;
+        for (size_t i = 0; i < slots; ++i) {
+            slots_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        writer_ = std::thread([this]() { drain(); });
+    }
+
+    ~WarningLog() { close(); }
+
+    WarningLog(const WarningLog&) = delete;
+    WarningLog& operator=(const WarningLog&) = delete;
+
+    const WarningLimits& limits() const { return limits_; }
+
+    // counts the warning and queues it if it is within the limits, may be called from any thread
+    void warn(size_t kind, std::string_view filename, std::string_view line, std::string_view field) override {
+        uint64_t index = counts_[kind].fetch_add(1, std::memory_order_relaxed);
+        if (index < limits_.burst || limits_.burst == 0 || sampled(line))
+            push(formatWarning(kind, filename, line, field));
+    }
+
+    // counts <n> warnings of <kind> that were not reported one by one because
+    // they are beyond the burst and not sampled anyway, see ChunkWarnings
+    void skip(size_t kind, uint64_t n) { counts_[kind].fetch_add(n, std::memory_order_relaxed); }
+
+    // queues <message> (a whole line, e.g. "[WARN] failed to write ...") as is, it is not limited
+    void print(const std::string& message) { push(message); }
+
+    // true if a warning about <line> past the burst of its kind is printed
+    bool sampled(std::string_view line) const {
+        if (limits_.sampleEvery <= 1)
+            return limits_.sampleEvery == 1;
+        uint64_t hash = 14695981039346656037ull; // FNV-1a
+        for (char c : line) {
+            hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+        }
+        return hash % limits_.sampleEvery == 0;
+    }
+
+    // waits until every warning queued so far is written out
+    void flush() {
+        size_t target = enqueuePos_.load(std::memory_order_acquire);
+        while (written_.load(std::memory_order_acquire) < target && writer_.joinable()) {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    }
+
+    // writes out what is queued and stops the background thread, no more warnings may be reported
+    void close() {
+        if (!writer_.joinable())
+            return;
+        stop_.store(true, std::memory_order_release);
+        writer_.join();
+    }
+
+    uint64_t count(size_t kind) const { return counts_[kind].load(std::memory_order_relaxed); }
+
+    // e.g. "[WARN] 4797 warning(s): 3210 noStatus, 1587 malformedPrice; first 100 of each kind printed, then 1 in 1000\n",
+    // empty if there were none
+    std::string summary() const {
+        uint64_t total = 0;
+        std::string kinds;
+        for (size_t kind = 0; kind < Warning::Count; ++kind) {
+            if (count(kind) == 0)
+                continue;
+            total += count(kind);
+            kinds += (kinds.empty() ? "" : ", ") + std::to_string(count(kind)) + " " + WARNING_NAMES[kind];
+        }
+        if (total == 0)
+            return "";
+        std::string text = "[WARN] " + std::to_string(total) + " warning(s): " + kinds;
+        if (limits_.burst > 0) {
+            text += "; first " + std::to_string(limits_.burst) + " of each kind printed";
+            if (limits_.sampleEvery > 1)
+                text += ", then 1 in " + std::to_string(limits_.sampleEvery);
+        }
+        return text + "\n";
+    }
+
+private:
+    struct Slot {
+        std::atomic<size_t> sequence; // the position this slot is free for, or that position + 1 once filled
+        size_t length;
+        char text[SLOT_TEXT];
+    };
+
+    WarningLimits limits_;
+    FILE* out_;
+    std::unique_ptr<Slot[]> slots_;
+    size_t mask_;
+    std::array<std::atomic<uint64_t>, Warning::Count> counts_{};
+    alignas(64) std::atomic<size_t> enqueuePos_{0};
+    alignas(64) std::atomic<size_t> written_{0}; // messages written out by the background thread
+    std::atomic<bool> stop_{false};
+    std::thread writer_;
+
+    void push(const std::string& message) {
+        size_t pos = enqueuePos_.load(std::memory_order_relaxed);
+        for (;;) {
+            Slot& slot = slots_[pos & mask_];
+            size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            if (sequence == pos) {
+                if (enqueuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    slot.length = std::min(message.size(), SLOT_TEXT);
+                    std::memcpy(slot.text, message.data(), slot.length);
+                    if (message.size() > SLOT_TEXT)
+                        std::memcpy(slot.text + SLOT_TEXT - 3, "...", 3);
+                    slot.sequence.store(pos + 1, std::memory_order_release);
+                    return;
+                }
+            } else if (sequence < pos) {
+                std::this_thread::yield(); // full, wait for the background thread to make room
+                pos = enqueuePos_.load(std::memory_order_relaxed);
+            } else {
+                pos = enqueuePos_.load(std::memory_order_relaxed); // another thread took the slot
+            }
+        }
+    }
+
+    // the background thread: writes out what is queued in batches, polling less
+    // often the longer the queue stays empty
+    void drain() {
+        std::string batch;
+        size_t next = 0; // position of the next message to write
+        auto idle = std::chrono::microseconds(500);
+        for (;;) {
+            bool stopping = stop_.load(std::memory_order_acquire);
+            size_t taken = 0;
+            while (batch.size() < (1 << 16)) {
+                Slot& slot = slots_[next & mask_];
+                if (slot.sequence.load(std::memory_order_acquire) != next + 1)
+                    break;
+                batch.append(slot.text, slot.length).append("\n");
+                slot.sequence.store(next + mask_ + 1, std::memory_order_release);
+                ++next;
+                ++taken;
+            }
+            if (taken > 0) {
+                std::fwrite(batch.data(), 1, batch.size(), out_);
+                std::fflush(out_);
+                batch.clear();
+                written_.fetch_add(taken, std::memory_order_release);
+                idle = std::chrono::microseconds(500);
+                continue;
+            }
+            if (stopping)
+                return;
+            std::this_thread::sleep_for(idle);
+            idle = std::min(idle * 2, std::chrono::microseconds(20000));
+        }
+    }
+};
+
+// Holds the warnings of a piece of a log parsed on its own thread, for a
+// WarningLog to report later in log order (see replayLogParallel() in calc.cpp).
+// Only the warnings the log could print are kept, as views into the mapped log:
+// the first burst of each kind within the piece (which includes any of the
+// first burst of the whole log) and the sampled ones. Of the others only the
+// index of the event they precede is kept, so the log can count exactly those
+// before the point the replay stopped at.
+class ChunkWarnings : public WarningSink {
+public:
+    struct Held {
+        size_t event;        // index of the event the warning precedes
+        size_t kind;
+        uint64_t skipped;    // warnings of the kind not held since the previous one held
+        std::string_view line;
+        std::string_view field;
+    };
+
+    explicit ChunkWarnings(const WarningLog& log) : log_(&log) {}
+
+    // the index of the event the next warnings precede
+    void setEvent(size_t event) { event_ = event; }
+
+    void warn(size_t kind, std::string_view, std::string_view line, std::string_view field) override {
+        if (counts_[kind]++ < log_->limits().burst || log_->limits().burst == 0 || log_->sampled(line)) {
+            held_.push_back(Held{event_, kind, skipped_[kind].size() - skippedHeld_[kind], line, field});
+            skippedHeld_[kind] = skipped_[kind].size();
+        } else {
+            skipped_[kind].push_back(static_cast<uint32_t>(event_));
+        }
+    }
+
+    const std::vector<Held>& held() const { return held_; }
+
+    // warnings of <kind> not held that precede the events up to index <event>
+    uint64_t skippedUpTo(size_t kind, size_t event) const {
+        return std::upper_bound(skipped_[kind].begin(), skipped_[kind].end(), event) - skipped_[kind].begin();
+    }
+
+private:
+    const WarningLog* log_;
+    size_t event_ = 0;
+    std::vector<Held> held_;
+    std::array<uint64_t, Warning::Count> counts_{};
+    std::array<std::vector<uint32_t>, Warning::Count> skipped_;  // the event index of each warning not held
+    std::array<uint64_t, Warning::Count> skippedHeld_{};          // of those, how many precede the last one held
+};
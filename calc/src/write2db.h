@@ -1,72 +1,656 @@
+#pragma once
+
 #include <iostream>
 #include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <memory>
+#include <functional>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
 
 #include <sqlite3.h> // Include the SQLite header file
 
+#include "cross_day_stats.h"
+#include "ticks.h"
+
+// One of the symbols with the highest exposure of a day, see LogStats::topSymbols
+struct TopSymbol {
+    std::string symbol;   // stock code, e.g. "5299"
+    Ticks peakAmount;     // highest amount of the symbol at a check point
+    std::string peakTime; // check point of the peak, e.g. "09:10:30"
+    int activeOrders;     // active orders of the symbol at the peak
+};
+
+// State at one check point, see LogStats::series
+struct CheckPointSample {
+    double checkTime; // seconds since midnight
+    int activeOrders;
+    Ticks amount;
+};
+
 // Define a struct to hold the log statistics
 typedef struct LogStats {
     int date;
     std::string tt;
+    std::string strategy;   // strategy prefix the stats are limited to when several are kept apart (-p C70,C71), else empty
+    double intervalSeconds; // time between check points, together with date the key of a row
     int numberOfLogs;
     int maxActiveOrders;
     double meanActiveOrders;
-    int medianActiveOrders;
+    double medianActiveOrders;
     double stddevActiveOrders;
-    double maxAmount;
+    Ticks maxAmount;        // amounts are in ticks (hundredths), stored in currency units
     double meanAmount;
     double medianAmount;
-    double minAmount;
+    Ticks minAmount;
     double stddevAmount;
+    std::vector<double> percentiles;             // e.g. {50, 90, 99, 99.9}
+    std::vector<double> activeOrdersPercentiles; // one value per entry of percentiles
+    std::vector<double> amountPercentiles;       // one value per entry of percentiles, in ticks
+    std::vector<uint8_t> activeOrdersHistogram;  // serialized LogLinearHistogram of all samples, see histogram.h
+    std::vector<uint8_t> amountHistogram;        // serialized LogLinearHistogram of all samples in ticks
+    std::vector<TopSymbol> topSymbols;           // highest peakAmount first, stored in the symbolsTable()
+    std::vector<CheckPointSample> series;        // every check point in time order if kept (--series), stored in the seriesTable()
 } LogStats;
 
-// function to execute an SQL statement and check for errors
-void checkSQLiteError(int rc, sqlite3* db) {
-    if (rc != SQLITE_OK) {
-        std::cerr << "SQLite error: " << sqlite3_errmsg(db) << std::endl;
-        sqlite3_close(db);
-        exit(EXIT_FAILURE);
+// Name of the table a LogStats record goes into: its tt, e.g. "ibfs", or
+// tt_strategy, e.g. "ibfs_C70", for stats of a single strategy
+std::string statsTable(const LogStats& stats) {
+    return stats.strategy.empty() ? stats.tt : stats.tt + "_" + stats.strategy;
+}
+
+// Name of the column holding a percentile, e.g. percentileColumn(99.9, "Amount") is "p99_9Amount"
+std::string percentileColumn(double percentile, const std::string& metric) {
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "p%g", percentile);
+    std::string column = buffer;
+    for (auto& c : column) {
+        if (c == '.') c = '_';
+    }
+    return column + metric;
+}
+
+// Names of the percentile columns <stats> is stored with, active orders first then amount
+std::vector<std::string> percentileColumns(const LogStats& stats) {
+    std::vector<std::string> columns;
+    for (double p : stats.percentiles) {
+        columns.push_back(percentileColumn(p, "ActiveOrders"));
+    }
+    for (double p : stats.percentiles) {
+        columns.push_back(percentileColumn(p, "Amount"));
+    }
+    return columns;
+}
+
+// The metrics of <stats> whose percentiles over all days are kept in the
+// percentilesTable() of its table, as <column, value> pairs in the units
+// bindLogStats() stores them in. Values that are not finite are left out.
+std::vector<std::pair<std::string, double>> statsMetrics(const LogStats& stats) {
+    std::vector<std::pair<std::string, double>> metrics = {
+        {"numberOfLogs", stats.numberOfLogs},
+        {"maxActiveOrders", stats.maxActiveOrders},
+        {"meanActiveOrders", stats.meanActiveOrders},
+        {"medianActiveOrders", stats.medianActiveOrders},
+        {"stddevActiveOrders", stats.stddevActiveOrders},
+        {"maxAmount", ticksToUnits(stats.maxAmount)},
+        {"meanAmount", ticksToUnits(stats.meanAmount)},
+        {"medianAmount", ticksToUnits(stats.medianAmount)},
+        {"minAmount", ticksToUnits(stats.minAmount)},
+        {"stddevAmount", ticksToUnits(stats.stddevAmount)}};
+    std::vector<std::string> columns = percentileColumns(stats);
+    for (size_t i = 0; i < stats.activeOrdersPercentiles.size() && i < stats.percentiles.size(); ++i) {
+        metrics.emplace_back(columns[i], stats.activeOrdersPercentiles[i]);
+    }
+    for (size_t i = 0; i < stats.amountPercentiles.size() && i < stats.percentiles.size(); ++i) {
+        metrics.emplace_back(columns[stats.percentiles.size() + i], ticksToUnits(stats.amountPercentiles[i]));
+    }
+    std::vector<std::pair<std::string, double>> finite;
+    for (const auto& metric : metrics) {
+        if (std::isfinite(metric.second))
+            finite.push_back(metric);
+    }
+    return finite;
+}
+
+// Percentiles over all days kept for every metric, the median and those of the rows
+std::vector<double> crossDayPercentiles(const LogStats& stats) {
+    std::vector<double> percentiles = {50};
+    for (double p : stats.percentiles) {
+        if (p != 50)
+            percentiles.push_back(p);
+    }
+    return percentiles;
+}
+
+// SQL to create the LogStats table named <tb_name> if not already existent
+std::string createTableSQL(const std::string& tb_name) {
+    return "CREATE TABLE IF NOT EXISTS " + tb_name + R"(
+           (date INT,
+            intervalSeconds REAL,
+            tt TEXT,
+            numberOfLogs INT,
+            maxActiveOrders INT,
+            meanActiveOrders REAL,
+            medianActiveOrders REAL,
+            stddevActiveOrders REAL,
+            maxAmount REAL,
+            meanAmount REAL,
+            medianAmount REAL,
+            minAmount REAL,
+            stddevAmount REAL,
+            activeOrdersHistogram BLOB,
+            amountHistogram BLOB,
+            PRIMARY KEY (date, intervalSeconds))
+    )";
+}
+
+// Name of the companion table holding the top symbols of the rows of <tb_name>, e.g. "ibfs_symbols"
+std::string symbolsTable(const std::string& tb_name) {
+    return tb_name + "_symbols";
+}
+
+// SQL to create the companion table of <tb_name> if not already existent, one
+// row per top symbol of a day and interval, ranked from 1 (highest peak)
+std::string createSymbolsTableSQL(const std::string& tb_name) {
+    return "CREATE TABLE IF NOT EXISTS " + symbolsTable(tb_name) + R"(
+           (date INT,
+            intervalSeconds REAL,
+            rank INT,
+            symbol TEXT,
+            peakAmount REAL,
+            peakTime TEXT,
+            activeOrders INT,
+            PRIMARY KEY (date, intervalSeconds, rank))
+    )";
+}
+
+// Name of the companion table holding the check point series of the rows of <tb_name>, e.g. "ibfs_series"
+std::string seriesTable(const std::string& tb_name) {
+    return tb_name + "_series";
+}
+
+// SQL to create the series table of <tb_name> if not already existent, one narrow
+// row per check point of a day and interval
+std::string createSeriesTableSQL(const std::string& tb_name) {
+    return "CREATE TABLE IF NOT EXISTS " + seriesTable(tb_name) + R"(
+           (date INT,
+            intervalSeconds REAL,
+            checkTime REAL,
+            activeOrders INT,
+            amount REAL,
+            PRIMARY KEY (date, intervalSeconds, checkTime))
+    )";
+}
+
+// SQL to select the date and histograms of every day of <tb_name> between two
+// dates (bound first, inclusive) sampled every intervalSeconds (bound last), in
+// date order. A row stored before the interval was recorded (see
+// addIntervalToKey()) stands in for a day that has no row at the interval.
+std::string selectHistogramsSQL(const std::string& tb_name) {
+    return "SELECT date, activeOrdersHistogram, amountHistogram FROM " + tb_name + " AS day"
+        " WHERE date BETWEEN ?1 AND ?2 AND (intervalSeconds = ?3 OR (intervalSeconds IS NULL AND NOT EXISTS"
+        " (SELECT 1 FROM " + tb_name + " WHERE date = day.date AND intervalSeconds = ?3))) ORDER BY date";
+}
+
+// Check points stored by a single INSERT into the series table, 5 bound values
+// each keeps a statement well below SQLite's historical limit of 999 parameters
+const size_t SERIES_ROWS_PER_INSERT = 128;
+
+// SQL to insert <rows> check points into the series table of <tb_name> with one statement
+std::string insertSeriesSQL(const std::string& tb_name, size_t rows) {
+    std::string sql = "INSERT INTO " + seriesTable(tb_name) + " (date, intervalSeconds, checkTime, activeOrders, amount) VALUES ";
+    for (size_t i = 0; i < rows; ++i) {
+        sql += i == 0 ? "(?, ?, ?, ?, ?)" : ", (?, ?, ?, ?, ?)";
     }
+    return sql;
 }
 
-// preapare LogStats record to be inserted into database table
-void insertLogStats(sqlite3* db, std::string tb_name, const LogStats& stats) {
-    std::string insertSQL = "INSERT OR REPLACE INTO " + tb_name + " (date, tt, "
+// SQL to insert (or replace) a LogStats record into the table named <tb_name>,
+// <extraColumns> (e.g. the percentile columns) follow the fixed ones
+std::string insertLogStatsSQL(const std::string& tb_name, const std::vector<std::string>& extraColumns = {}) {
+    std::string columns = "date, intervalSeconds, tt, "
         "numberOfLogs, maxActiveOrders, meanActiveOrders, medianActiveOrders, "
         "stddevActiveOrders, maxAmount, meanAmount, medianAmount, minAmount, "
-        "stddevAmount) " "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)";
-
-    sqlite3_stmt* stmt;
-    int rc = sqlite3_prepare_v2(db, insertSQL.c_str(), -1, &stmt, nullptr);
-    checkSQLiteError(rc, db);
+        "stddevAmount, activeOrdersHistogram, amountHistogram";
+    std::string values = "?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?";
+    for (const auto& column : extraColumns) {
+        columns += ", " + column;
+        values += ", ?";
+    }
+    return "INSERT OR REPLACE INTO " + tb_name + " (" + columns + ") VALUES (" + values + ")";
+}
 
+// bind LogStats record to a statement prepared from insertLogStatsSQL() with
+// the columns of percentileColumns(stats)
+void bindLogStats(sqlite3_stmt* stmt, const LogStats& stats) {
     int cnt = 1;
-    // Bind values to the parameters
     sqlite3_bind_int(stmt, cnt++, stats.date);
-    sqlite3_bind_text(stmt, cnt++, stats.tt.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_double(stmt, cnt++, stats.intervalSeconds);
+    sqlite3_bind_text(stmt, cnt++, stats.tt.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_bind_int(stmt, cnt++, stats.numberOfLogs);
     sqlite3_bind_int(stmt, cnt++, stats.maxActiveOrders);
-    sqlite3_bind_int(stmt, cnt++, stats.meanActiveOrders);
+    sqlite3_bind_double(stmt, cnt++, stats.meanActiveOrders);
     sqlite3_bind_double(stmt, cnt++, stats.medianActiveOrders);
     sqlite3_bind_double(stmt, cnt++, stats.stddevActiveOrders);
-    sqlite3_bind_double(stmt, cnt++, stats.maxAmount);
-    sqlite3_bind_double(stmt, cnt++, stats.meanAmount);
-    sqlite3_bind_double(stmt, cnt++, stats.medianAmount);
-    sqlite3_bind_double(stmt, cnt++, stats.minAmount);
-    sqlite3_bind_double(stmt, cnt++, stats.stddevAmount);
+    sqlite3_bind_double(stmt, cnt++, ticksToUnits(stats.maxAmount));
+    sqlite3_bind_double(stmt, cnt++, ticksToUnits(stats.meanAmount));
+    sqlite3_bind_double(stmt, cnt++, ticksToUnits(stats.medianAmount));
+    sqlite3_bind_double(stmt, cnt++, ticksToUnits(stats.minAmount));
+    sqlite3_bind_double(stmt, cnt++, ticksToUnits(stats.stddevAmount));
+    for (const auto* blob : {&stats.activeOrdersHistogram, &stats.amountHistogram}) {
+        if (blob->empty()) {
+            sqlite3_bind_null(stmt, cnt++);
+        } else {
+            sqlite3_bind_blob(stmt, cnt++, blob->data(), static_cast<int>(blob->size()), SQLITE_TRANSIENT);
+        }
+    }
+    for (double value : stats.activeOrdersPercentiles) {
+        sqlite3_bind_double(stmt, cnt++, value);
+    }
+    for (double value : stats.amountPercentiles) {
+        sqlite3_bind_double(stmt, cnt++, ticksToUnits(value));
+    }
+}
 
-    // Execute the insert statement
-    rc = sqlite3_step(stmt);
-    if (rc != SQLITE_DONE) {
-        std::cerr << "Execution failed: " << sqlite3_errmsg(db) << std::endl;
-    } else {
-        std::cout << "Data inserted successfully." << std::endl;
+// Long-lived sink for LogStats records. The connection and the prepared INSERT
+// of every table are kept for the lifetime of the writer, rows are grouped into
+// explicit transactions of up to <batchSize> rows and the database runs in WAL
+// mode, so bulk loads cost one commit per batch instead of one per row.
+//
+// Every row also updates the percentiles over all days of its table (see
+// CrossDayPercentiles), so they are read back with a lookup, e.g. the median
+// of the daily maxAmount in the percentilesTable():
+//      SELECT value FROM ibfs_percentiles WHERE metric = 'maxAmount' AND intervalSeconds = 30 AND percentile = 50
+//
+// Errors never terminate the process: every call returns false on failure and
+// lastError() tells what went wrong. A row insert() fails on leaves nothing
+// behind (its statements share a savepoint), the rows before it stay pending.
+// Rows still pending are committed by commit(), close() or the destructor.
+//
+// For example:
+//      LogStatsWriter writer;
+//      if (!writer.open("sql/oddlot.db") || !writer.insert(stats, "ibfs") || !writer.commit())
+//          std::cerr << writer.lastError() << std::endl;
+class LogStatsWriter {
+public:
+    explicit LogStatsWriter(size_t batchSize = 1000) : batchSize_(batchSize ? batchSize : 1) {}
+
+    ~LogStatsWriter() { close(); }
+
+    LogStatsWriter(const LogStatsWriter&) = delete;
+    LogStatsWriter& operator=(const LogStatsWriter&) = delete;
+
+    // opens (or creates) the database file at <path>
+    bool open(const std::string& path) {
+        close();
+        if (sqlite3_open(path.c_str(), &db_) != SQLITE_OK) {
+            fail("unable to open " + path);
+            sqlite3_close(db_);
+            db_ = nullptr;
+            return false;
+        }
+        // WAL lets a commit append to the log instead of rewriting the database file
+        return exec("PRAGMA journal_mode=WAL");
     }
 
-    // Finalize the statement to release resources
-    sqlite3_finalize(stmt);
-}
+    bool isOpen() const { return db_ != nullptr; }
+
+    // queues <stats> into the table <tb_name>, creating the table (or the
+    // missing percentile columns of an existing one) on first use. The top
+    // symbols and the series, if any, replace those of the same day and
+    // interval in the symbolsTable() and seriesTable() of <tb_name>, its
+    // metrics those in the sortedTable() and percentilesTable().
+    bool insert(const LogStats& stats, const std::string& tb_name) {
+        sqlite3_stmt* stmt = insertStatement(tb_name, percentileColumns(stats));
+        if (!stmt || !begin())
+            return false;
+        CrossDayPercentiles* percentiles = crossDay(tb_name);
+        if (!percentiles || !exec("SAVEPOINT row"))
+            return false;
+        // a row takes several statements, all of them or none are kept
+        percentiles->save();
+        if (!insertRow(stats, tb_name, stmt, *percentiles)) {
+            std::string error = lastError_;
+            percentiles->undo();
+            releaseStatements(); // some may refer to tables created by the rolled back statements
+            if (!exec("ROLLBACK TO row") || !exec("RELEASE row"))
+                rollback(); // SQLite already rolled back the whole transaction
+            lastError_ = error;
+            return false;
+        }
+        if (!exec("RELEASE row"))
+            return false;
+        if (++pending_ >= batchSize_)
+            return commit();
+        return true;
+    }
 
-// opens database and create table if not already existent then inserts the 
+    // queues a row of a table other than a LogStats one, e.g. run_metrics, in the
+    // same batches as insert(): <sql> is an INSERT prepared once per connection,
+    // <bind> binds its parameters. The table must exist, see exec().
+    bool insert(const std::string& sql, const std::function<void(sqlite3_stmt*)>& bind) {
+        sqlite3_stmt* stmt = cachedStatement(sql, sql); // SQL has spaces, no table name or key of insertStatement() does
+        if (!stmt || !begin())
+            return false;
+        bind(stmt);
+        int rc = sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+        sqlite3_clear_bindings(stmt);
+        if (rc != SQLITE_DONE)
+            return fail(sql);
+        if (++pending_ >= batchSize_)
+            return commit();
+        return true;
+    }
+
+    // commits the rows inserted so far
+    bool commit() {
+        if (!inTransaction_)
+            return true;
+        bool ok = true;
+        for (auto& entry : crossDay_) {
+            if (!entry.second->flush()) {
+                fail("update of " + percentilesTable(entry.first) + " failed");
+                ok = false;
+                break;
+            }
+        }
+        if (ok && exec("COMMIT")) {
+            inTransaction_ = false;
+            pending_ = 0;
+            return true;
+        }
+        // neither the rows nor the percentiles moved for them are kept
+        std::string error = lastError_;
+        rollback();
+        lastError_ = error;
+        return false;
+    }
+
+    // discards the rows inserted since the last commit, and the percentiles moved
+    // for them; the sorted and percentiles tables are set up again on next use, as
+    // the rolled back transaction may have created or filled them
+    bool rollback() {
+        crossDay_.clear();
+        if (!inTransaction_)
+            return true;
+        inTransaction_ = false;
+        pending_ = 0;
+        return exec("ROLLBACK");
+    }
+
+    // commits pending rows and releases the statements and the connection
+    bool close() {
+        if (!db_)
+            return true;
+        bool ok = commit();
+        crossDay_.clear();
+        releaseStatements();
+        sqlite3_close(db_);
+        db_ = nullptr;
+        return ok;
+    }
+
+    const std::string& lastError() const { return lastError_; }
+
+    // runs a statement that returns no rows of interest
+    bool exec(const std::string& sql) {
+        if (!db_)
+            return fail("database is not open");
+        if (sqlite3_exec(db_, sql.c_str(), nullptr, nullptr, nullptr) != SQLITE_OK)
+            return fail(sql);
+        return true;
+    }
+
+private:
+    sqlite3* db_ = nullptr;
+    std::map<std::string, sqlite3_stmt*> inserts_; // <table name and extra columns, prepared insert>, see also insertTopSymbols()
+    size_t batchSize_;
+    size_t pending_ = 0;
+    bool inTransaction_ = false;
+    std::map<std::string, std::unique_ptr<CrossDayPercentiles>> crossDay_; // <table name, its percentiles over all days>
+    std::string lastError_;
+
+    // stores <stats> with <stmt> prepared by insertStatement(), see insert()
+    bool insertRow(const LogStats& stats, const std::string& tb_name, sqlite3_stmt* stmt, CrossDayPercentiles& percentiles) {
+        if (!percentiles.update(stats.intervalSeconds, stats.date, statsMetrics(stats), crossDayPercentiles(stats)))
+            return fail("update of the percentiles of " + tb_name + " failed");
+        bindLogStats(stmt, stats);
+        int rc = sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+        sqlite3_clear_bindings(stmt);
+        if (rc != SQLITE_DONE)
+            return fail("insert into " + tb_name + " failed");
+        if (!stats.topSymbols.empty() && !insertTopSymbols(stats, tb_name))
+            return false;
+        if (!stats.series.empty() && !insertSeries(stats, tb_name))
+            return false;
+        return true;
+    }
+
+    // finalizes the prepared statements of the tables, they are prepared again on next use
+    void releaseStatements() {
+        for (auto& entry : inserts_) {
+            sqlite3_finalize(entry.second);
+        }
+        inserts_.clear();
+    }
+
+    // the percentiles over all days of <tb_name>, set up on first use once the table exists
+    CrossDayPercentiles* crossDay(const std::string& tb_name) {
+        auto it = crossDay_.find(tb_name);
+        if (it != crossDay_.end())
+            return it->second.get();
+        std::vector<std::pair<std::string, std::string>> columns;
+        if (!tableColumns(tb_name, columns))
+            return nullptr;
+        std::vector<std::string> metrics;
+        for (const auto& column : columns) {
+            if (column.first != "date" && column.first != "intervalSeconds" && (column.second == "INT" || column.second == "REAL"))
+                metrics.push_back(column.first);
+        }
+        auto percentiles = std::make_unique<CrossDayPercentiles>(db_, tb_name);
+        if (!percentiles->open(metrics)) {
+            fail("unable to create " + sortedTable(tb_name));
+            return nullptr;
+        }
+        return crossDay_.emplace(tb_name, std::move(percentiles)).first->second.get();
+    }
+
+    bool fail(const std::string& what) {
+        lastError_ = "SQLite error: " + what;
+        if (db_)
+            lastError_ += ": " + std::string(sqlite3_errmsg(db_));
+        return false;
+    }
+
+    bool begin() {
+        if (inTransaction_)
+            return true;
+        if (!exec("BEGIN TRANSACTION"))
+            return false;
+        inTransaction_ = true;
+        return true;
+    }
+
+    sqlite3_stmt* insertStatement(const std::string& tb_name, const std::vector<std::string>& extraColumns) {
+        std::string key = tb_name;
+        for (const auto& column : extraColumns) {
+            key += "," + column;
+        }
+        auto it = inserts_.find(key);
+        if (it != inserts_.end())
+            return it->second;
+        std::vector<std::pair<std::string, std::string>> columns = {
+            {"activeOrdersHistogram", "BLOB"}, {"amountHistogram", "BLOB"}};
+        for (const auto& column : extraColumns) {
+            columns.emplace_back(column, "REAL");
+        }
+        if (!exec(createTableSQL(tb_name)) || !addIntervalToKey(tb_name) || !addMissingColumns(tb_name, columns))
+            return nullptr;
+        sqlite3_stmt* stmt = nullptr;
+        if (sqlite3_prepare_v2(db_, insertLogStatsSQL(tb_name, extraColumns).c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+            fail("unable to prepare insert into " + tb_name);
+            return nullptr;
+        }
+        inserts_.emplace(key, stmt);
+        return stmt;
+    }
+
+    // statement prepared from <sql>, kept under <key> for the lifetime of the connection
+    sqlite3_stmt* cachedStatement(const std::string& key, const std::string& sql) {
+        auto it = inserts_.find(key);
+        if (it != inserts_.end())
+            return it->second;
+        sqlite3_stmt* stmt = nullptr;
+        if (sqlite3_prepare_v2(db_, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+            fail("unable to prepare " + sql);
+            return nullptr;
+        }
+        inserts_.emplace(key, stmt);
+        return stmt;
+    }
+
+    bool insertTopSymbols(const LogStats& stats, const std::string& tb_name) {
+        std::string table = symbolsTable(tb_name);
+        // '#' never appears in a table name, so these keys never clash with insertStatement()'s
+        if (inserts_.count("#delete " + table) == 0 && !exec(createSymbolsTableSQL(tb_name)))
+            return false;
+        sqlite3_stmt* remove = cachedStatement("#delete " + table, "DELETE FROM " + table + " WHERE date = ? AND intervalSeconds = ?");
+        sqlite3_stmt* insert = cachedStatement("#insert " + table, "INSERT INTO " + table +
+            " (date, intervalSeconds, rank, symbol, peakAmount, peakTime, activeOrders) VALUES (?, ?, ?, ?, ?, ?, ?)");
+        if (!remove || !insert)
+            return false;
+        sqlite3_bind_int(remove, 1, stats.date);
+        sqlite3_bind_double(remove, 2, stats.intervalSeconds);
+        int rc = sqlite3_step(remove);
+        sqlite3_reset(remove);
+        if (rc != SQLITE_DONE)
+            return fail("delete from " + table + " failed");
+        for (size_t i = 0; i < stats.topSymbols.size(); ++i) {
+            const TopSymbol& top = stats.topSymbols[i];
+            int cnt = 1;
+            sqlite3_bind_int(insert, cnt++, stats.date);
+            sqlite3_bind_double(insert, cnt++, stats.intervalSeconds);
+            sqlite3_bind_int(insert, cnt++, static_cast<int>(i + 1));
+            sqlite3_bind_text(insert, cnt++, top.symbol.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_double(insert, cnt++, ticksToUnits(top.peakAmount));
+            sqlite3_bind_text(insert, cnt++, top.peakTime.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_int(insert, cnt++, top.activeOrders);
+            rc = sqlite3_step(insert);
+            sqlite3_reset(insert);
+            if (rc != SQLITE_DONE)
+                return fail("insert into " + table + " failed");
+        }
+        return true;
+    }
+
+    // Stores the series SERIES_ROWS_PER_INSERT rows per statement, within the
+    // transaction of the LogStats row, so a day of one second check points costs
+    // about a hundred statement executions rather than fifteen thousand
+    bool insertSeries(const LogStats& stats, const std::string& tb_name) {
+        std::string table = seriesTable(tb_name);
+        if (inserts_.count("#delete " + table) == 0 && !exec(createSeriesTableSQL(tb_name)))
+            return false;
+        sqlite3_stmt* remove = cachedStatement("#delete " + table, "DELETE FROM " + table + " WHERE date = ? AND intervalSeconds = ?");
+        sqlite3_stmt* insertMany = cachedStatement("#insert " + table, insertSeriesSQL(tb_name, SERIES_ROWS_PER_INSERT));
+        sqlite3_stmt* insertOne = cachedStatement("#insert one " + table, insertSeriesSQL(tb_name, 1));
+        if (!remove || !insertMany || !insertOne)
+            return false;
+        sqlite3_bind_int(remove, 1, stats.date);
+        sqlite3_bind_double(remove, 2, stats.intervalSeconds);
+        int rc = sqlite3_step(remove);
+        sqlite3_reset(remove);
+        if (rc != SQLITE_DONE)
+            return fail("delete from " + table + " failed");
+        size_t i = 0;
+        while (i < stats.series.size()) {
+            size_t rows = stats.series.size() - i >= SERIES_ROWS_PER_INSERT ? SERIES_ROWS_PER_INSERT : 1;
+            sqlite3_stmt* stmt = rows > 1 ? insertMany : insertOne;
+            int cnt = 1;
+            for (size_t end = i + rows; i < end; ++i) {
+                const CheckPointSample& sample = stats.series[i];
+                sqlite3_bind_int(stmt, cnt++, stats.date);
+                sqlite3_bind_double(stmt, cnt++, stats.intervalSeconds);
+                sqlite3_bind_double(stmt, cnt++, sample.checkTime);
+                sqlite3_bind_int(stmt, cnt++, sample.activeOrders);
+                sqlite3_bind_double(stmt, cnt++, ticksToUnits(sample.amount));
+            }
+            rc = sqlite3_step(stmt);
+            sqlite3_reset(stmt);
+            if (rc != SQLITE_DONE)
+                return fail("insert into " + table + " failed");
+        }
+        return true;
+    }
+
+    // stores the <name, type> pairs of the columns of <tb_name> in <columns>
+    bool tableColumns(const std::string& tb_name, std::vector<std::pair<std::string, std::string>>& columns) {
+        sqlite3_stmt* stmt = nullptr;
+        if (sqlite3_prepare_v2(db_, ("PRAGMA table_info(" + tb_name + ")").c_str(), -1, &stmt, nullptr) != SQLITE_OK)
+            return fail("unable to read columns of " + tb_name);
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            const unsigned char* type = sqlite3_column_text(stmt, 2);
+            columns.emplace_back(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1)), type ? reinterpret_cast<const char*>(type) : "");
+        }
+        sqlite3_finalize(stmt);
+        return true;
+    }
+
+    // tables created before a column was introduced get it added here
+    //
+    // Arguments:
+    //      <columns> are the <name, type> pairs the table must have
+    bool addMissingColumns(const std::string& tb_name, const std::vector<std::pair<std::string, std::string>>& columns) {
+        std::vector<std::pair<std::string, std::string>> current;
+        if (!tableColumns(tb_name, current))
+            return false;
+        std::set<std::string> existing;
+        for (const auto& column : current) {
+            existing.insert(column.first);
+        }
+        for (const auto& column : columns) {
+            if (existing.count(column.first) == 0 && !exec("ALTER TABLE " + tb_name + " ADD COLUMN " + column.first + " " + column.second))
+                return false;
+        }
+        return true;
+    }
+
+    // Tables created before the interval was stored were keyed by date alone.
+    // SQLite cannot change a primary key in place, so such a table is rebuilt with
+    // the (date, intervalSeconds) key and its rows are copied over with a NULL
+    // interval, as it was not recorded. All or nothing, inside a savepoint.
+    bool addIntervalToKey(const std::string& tb_name) {
+        std::vector<std::pair<std::string, std::string>> columns;
+        if (!tableColumns(tb_name, columns))
+            return false;
+        std::string names;
+        for (const auto& column : columns) {
+            if (column.first == "intervalSeconds")
+                return true;
+            names += (names.empty() ? "" : ", ") + column.first;
+        }
+        std::string old = tb_name + "_keyed_by_date";
+        if (!exec("SAVEPOINT add_interval_to_key"))
+            return false;
+        if (exec("ALTER TABLE " + tb_name + " RENAME TO " + old) &&
+            exec(createTableSQL(tb_name)) &&
+            addMissingColumns(tb_name, columns) &&
+            exec("INSERT INTO " + tb_name + " (" + names + ") SELECT " + names + " FROM " + old) &&
+            exec("DROP TABLE " + old))
+            return exec("RELEASE add_interval_to_key");
+        std::string error = lastError_;
+        exec("ROLLBACK TO add_interval_to_key");
+        exec("RELEASE add_interval_to_key");
+        lastError_ = error;
+        return false;
+    }
+};
+
+// opens database and create table if not already existent then inserts the
 // LogStats record into said table, closes databse after work is done
 //
 // Arguments:
@@ -74,38 +658,39 @@ void insertLogStats(sqlite3* db, std::string tb_name, const LogStats& stats) {
 //      <tb_name> table name
 //      <outputDB> path to database file
 int write2db(LogStats stats, std::string tb_name, std::string outputDB) {
-    sqlite3* db; // SQLite database object
-    int rc;      // Result code
-
-    // Open the SQLite database
-    rc = sqlite3_open(outputDB.c_str(), &db); // Open a database file
-    checkSQLiteError(rc, db);
-
-    // Create the table with table name
-    std::string createTableSQL = "CREATE TABLE IF NOT EXISTS " + tb_name + R"(
-           (date INT PRIMARY KEY, 
-            tt TEXT,
-            numberOfLogs INT,
-            maxActiveOrders INT,
-            meanActiveOrders REAL,
-            medianActiveOrders INT,
-            stddevActiveOrders REAL,
-            maxAmount REAL,
-            meanAmount REAL,
-            medianAmount REAL,
-            minAmount REAL,
-            stddevAmount REAL)
-    )";
-    rc = sqlite3_exec(db, createTableSQL.c_str(), nullptr, nullptr, nullptr);
-    checkSQLiteError(rc, db);
-    std::cout << "Table created successfully." << std::endl;
-
-    // Insert the log statistics into the database
-    insertLogStats(db, tb_name, stats);
-
-    // Close the SQLite database
-    sqlite3_close(db);
-
+    LogStatsWriter writer;
+    if (!writer.open(outputDB) || !writer.insert(stats, tb_name) || !writer.close()) {
+        std::cerr << writer.lastError() << std::endl;
+        return 1;
+    }
+    std::cout << "Data inserted successfully." << std::endl;
     return 0;
 }
 
+// opens database once and inserts all the LogStats records inside a single
+// transaction (each goes into its statsTable()), so a whole batch of
+// days costs one commit
+//
+// Arguments:
+//      <stats> log stats to be inserted
+//      <outputDB> path to database file
+int write2db(const std::vector<LogStats>& stats, std::string outputDB) {
+    LogStatsWriter writer(stats.size());
+    if (!writer.open(outputDB)) {
+        std::cerr << writer.lastError() << std::endl;
+        return 1;
+    }
+    for (const auto& s : stats) {
+        if (!writer.insert(s, statsTable(s))) {
+            std::cerr << writer.lastError() << std::endl;
+            writer.rollback(); // all or nothing
+            return 1;
+        }
+    }
+    if (!writer.close()) {
+        std::cerr << writer.lastError() << std::endl;
+        return 1;
+    }
+    std::cout << "Committed " << stats.size() << " record(s)." << std::endl;
+    return 0;
+}
@@ -1,7 +1,34 @@
 #include <iostream>
+#include <fstream>
+#include <filesystem>
 #include <set>
+#include <random>
+#include <thread>
+#include <atomic>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
 #include <gtest/gtest.h>
+#include "alloc_counter.h"
 #include "calc.h"
+#include "cross_day_stats.h"
+#include "event_cache.h"
+#include "event_parser.h"
+#include "follow_log.h"
+#include "gzip_log.h"
+#include "histogram.h"
+#include "log_filter.h"
+#include "log_generator.h"
+#include "log_reader.h"
+#include "order_replay.h"
+#include "order_table.h"
+#include "process_log.h"
+#include "run_metrics.h"
+#include "ticks.h"
+#include "warning_log.h"
+#include "write2db.h"
 
 template<typename T>
 bool areVectorsEqualUnordered(const std::vector<T>& vec1, const std::vector<T>& vec2) {
@@ -39,6 +66,67 @@ TEST(CalcTest, getNextNthEntryEdge2) {
     EXPECT_EQ(getNextNthEntry(edge2, "std::string", 1), std::nullopt);
 }
 
+TEST(CalcTest, tokenizeLineOrderReport) {
+    std::string line = "09:13:06.012430 11 [Trace][][OrderReport]Tradetron 09:13:06.011 779c0098490 g01Ot C703002017 5299 IntraDayOdd ROD Buy 109.5 223 0000=OrderSuccess RR ";
+    LogFields fields;
+    EXPECT_TRUE(tokenizeLine(line, fields));
+    EXPECT_EQ(fields[Field::Timestamp], "09:13:06.012430");
+    EXPECT_EQ(fields[Field::Thread], "11");
+    EXPECT_EQ(fields[Field::Tag], "[Trace][][OrderReport]Tradetron");
+    EXPECT_EQ(fields[Field::Strategy], "C703002017");
+    EXPECT_EQ(fields[Field::Symbol], "5299");
+    EXPECT_EQ(fields[Field::Side], "Buy");
+    EXPECT_EQ(fields[Field::Price], "109.5");
+    EXPECT_EQ(fields[Field::Qty], "223");
+    EXPECT_EQ(fields[Field::Status], "0000=OrderSuccess");
+}
+
+TEST(CalcTest, tokenizeLineMissingFields) {
+    LogFields fields;
+    EXPECT_FALSE(tokenizeLine("09:13:06.012430 11 [Trace][][OrderReport]Tradetron no side here", fields));
+    EXPECT_TRUE(fields[Field::Side].empty());
+    EXPECT_EQ(fields[Field::Tag], "[Trace][][OrderReport]Tradetron");
+
+    EXPECT_FALSE(tokenizeLine("09:13:06.012430 11 [Trace][][MatchReport]Tradetron C703002017 5299 IntraDayOdd ROD Buy 109.5", fields));
+    EXPECT_EQ(fields[Field::Price], "109.5");
+    EXPECT_TRUE(fields[Field::Qty].empty());
+
+    EXPECT_TRUE(tokenizeLine("09:13:06.012430  11 [Trace]  C703002017 5299 IntraDayOdd ROD Sell  63.8 999", fields));
+    EXPECT_EQ(fields[Field::Thread], "11");
+    EXPECT_EQ(fields[Field::Side], "Sell");
+    EXPECT_EQ(fields[Field::Qty], "999");
+    EXPECT_TRUE(fields[Field::Status].empty());
+}
+
+TEST(CalcTest, findSubstring) {
+    std::string haystack = "09:13:06.012430 11 [Trace][][OrderReport]Tradetron 09:13:06.011 779c0098490 g01Ot C703002017 5299 IntraDayOdd ROD Buy 109.5 223 0000=OrderSuccess RR";
+    for (std::string needle : {"09:13", "OrderReport", "C70", "RR", "R", "Tradetron 09", "0000=OrderSuccess RR"}) {
+        EXPECT_EQ(findSubstring(haystack, needle), haystack.find(needle)) << needle;
+    }
+    EXPECT_EQ(findSubstring(haystack, "Sell"), std::string_view::npos);
+    EXPECT_EQ(findSubstring(haystack, "RRR"), std::string_view::npos);
+    EXPECT_EQ(findSubstring(haystack, "09:13", 1), haystack.find("09:13", 1));
+    EXPECT_EQ(findSubstring(haystack, "RR", haystack.size()), std::string_view::npos);
+    EXPECT_EQ(findSubstring("ab", "abc"), std::string_view::npos);
+}
+
+TEST(CalcTest, logFilterDefaults) {
+    LogFilter filter;
+    EXPECT_TRUE(filter.accept("09:13:06.012430 11 [Trace][][OrderReport]Tradetron 09:13:06.011 779c0098490 g01Ot C703002017 5299 IntraDayOdd ROD Buy 109.5 223 0000=OrderSuccess RR"));
+    EXPECT_TRUE(filter.accept("09:13:01.021246 11 [Trace][][OrderUpdate]Tradetron 09:13:01.003 779c0098490 g01Cs C703001699 2615 IntraDayOdd ROD Buy 63.8 999 0000=CancelSuccess RR"));
+    EXPECT_TRUE(filter.accept("09:13:10.000001 12 [Trace][][MatchReport]Tradetron 09:13:10.000 779c0098490 g01Ot C713002017 5299 IntraDayOdd ROD Buy 109.5 100 RR"));
+    EXPECT_FALSE(filter.accept("09:13:06.012430 11 [Trace][][OrderReport]Tradetron 09:13:06.011 779c0098490 g01Ot C713002017 5299 IntraDayOdd ROD Buy 109.5 223 0000=OrderSuccess RR"));
+    EXPECT_FALSE(filter.accept("09:13:10.000001 12 [Trace][][MatchReport]Tradetron 09:13:10.000 779c0098490 g01Ot C703002017 5299 IntraDayOdd ROD Sell 109.5 100 RR"));
+    EXPECT_FALSE(filter.accept("09:13:10.000001 12 [Trace][][Heartbeat] C70 IntraDayOdd Buy"));
+    EXPECT_FALSE(filter.accept("C70 before [Trace][][OrderReport]"));
+
+    filter.strategyPrefixes = {"C71"};
+    EXPECT_TRUE(filter.accept("09:13:06.012430 11 [Trace][][OrderReport]Tradetron 09:13:06.011 779c0098490 g01Ot C713002017 5299 IntraDayOdd ROD Buy 109.5 223 0000=OrderSuccess RR"));
+    EXPECT_FALSE(filter.accept("09:13:06.012430 11 [Trace][][OrderReport]Tradetron 09:13:06.011 779c0098490 g01Ot C703002017 5299 IntraDayOdd ROD Buy 109.5 223 0000=OrderSuccess RR"));
+    filter.strategyPrefixes = {"C71", "C70"};
+    EXPECT_TRUE(filter.accept("09:13:06.012430 11 [Trace][][OrderReport]Tradetron 09:13:06.011 779c0098490 g01Ot C703002017 5299 IntraDayOdd ROD Buy 109.5 223 0000=OrderSuccess RR"));
+}
+
 TEST(CalcTest, genCheckPointsEven) {
     std::string t1 = "09:00:00";
     std::string t2 = "10:00:00";
@@ -67,6 +155,1559 @@ TEST(CalcTest, genCheckPointsEdge2) {
     EXPECT_TRUE(areVectorsEqualUnordered(genCheckPoints(t1, t2, 5), tps));
 }
 
+TEST(CalcTest, mappedLogLines) {
+    std::string path = ::testing::TempDir() + "mapped_log_lines.txt";
+    {
+        std::ofstream out(path);
+        out << "first line\n\nthird line\nno trailing newline";
+    }
+    MappedLog log(path);
+    ASSERT_TRUE(log.isOpen());
+    std::vector<std::string> lines;
+    std::string_view line;
+    while (log.nextLine(line)) {
+        lines.emplace_back(line);
+    }
+    std::vector<std::string> expected = {"first line", "", "third line", "no trailing newline"};
+    EXPECT_EQ(lines, expected);
+}
+
+TEST(CalcTest, mappedLogMissingFile) {
+    MappedLog log(::testing::TempDir() + "does_not_exist.txt");
+    EXPECT_FALSE(log.isOpen());
+    std::string_view line;
+    EXPECT_FALSE(log.nextLine(line));
+}
+
+TEST(CalcTest, splitLinesKeepsLinesWhole) {
+    EXPECT_EQ(splitLines("a\nb\nc\nd\n", 2), std::vector<std::string_view>({"a\nb\n", "c\nd\n"}));
+    EXPECT_EQ(splitLines("long line\nb\nno trailing newline", 4),
+        std::vector<std::string_view>({"long line\n", "b\nno trailing newline"}));
+    EXPECT_EQ(splitLines("a\nb\n", 1), std::vector<std::string_view>({"a\nb\n"}));
+    EXPECT_EQ(splitLines("a\nb\n", 100), std::vector<std::string_view>({"a\n", "b\n"}));
+    EXPECT_TRUE(splitLines("", 4).empty());
+}
+
+TEST(CalcTest, followLogReadsAppendedLines) {
+    std::string path = ::testing::TempDir() + "follow_log.txt";
+    std::ofstream out(path);
+    out << "first line\nsecond " << std::flush;
+    std::atomic<bool> stop{false};
+    FollowLog log(path, &stop);
+    ASSERT_TRUE(log.isOpen());
+    std::string_view line;
+    ASSERT_TRUE(log.nextLine(line));
+    EXPECT_EQ(line, "first line");
+    // the partial line is not handed out, the log is quiet for now
+    ASSERT_TRUE(log.nextLine(line));
+    EXPECT_TRUE(line.empty());
+    out << "line\nthird line\n" << std::flush;
+    ASSERT_TRUE(log.nextLine(line));
+    EXPECT_EQ(line, "second line");
+    ASSERT_TRUE(log.nextLine(line));
+    EXPECT_EQ(line, "third line");
+    stop = true;
+    EXPECT_FALSE(log.nextLine(line));
+}
+
+TEST(CalcTest, followLogWakesOnWrite) {
+    std::string path = ::testing::TempDir() + "follow_log_wake.txt";
+    std::ofstream out(path);
+    FollowLog log(path);
+    std::thread writer([&out]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        out << "written later\n" << std::flush;
+    });
+    std::string_view line;
+    do {
+        ASSERT_TRUE(log.nextLine(line));
+    } while (line.empty());
+    writer.join();
+    EXPECT_EQ(line, "written later");
+}
+
+TEST(CalcTest, followLogMissingFile) {
+    FollowLog log(::testing::TempDir() + "does_not_exist.txt");
+    EXPECT_FALSE(log.isOpen());
+    std::string_view line;
+    EXPECT_FALSE(log.nextLine(line));
+}
+
+// writes <content> gzip-compressed to <path>
+void writeGzip(const std::string& path, const std::string& content) {
+    gzFile out = gzopen(path.c_str(), "wb");
+    ASSERT_NE(out, nullptr);
+    ASSERT_EQ(gzwrite(out, content.data(), static_cast<unsigned>(content.size())), static_cast<int>(content.size()));
+    gzclose(out);
+}
+
+TEST(CalcTest, gzipLogLines) {
+    std::string path = ::testing::TempDir() + "gzip_log_lines.ibfs.gz";
+    std::vector<std::string> expected = {"first line", "", "third line", std::string(100, 'x'), "no trailing newline"};
+    std::string content;
+    for (const auto& line : expected) {
+        content += line + "\n";
+    }
+    content.pop_back();
+    writeGzip(path, content);
+    // tiny chunks so lines are split across chunks and one is longer than a chunk
+    for (size_t chunkSize : {size_t(7), size_t(16), GzipLog::DEFAULT_CHUNK_SIZE}) {
+        GzipLog log(path, chunkSize);
+        ASSERT_TRUE(log.isOpen());
+        std::vector<std::string> lines;
+        std::string_view line;
+        while (log.nextLine(line)) {
+            lines.emplace_back(line);
+        }
+        EXPECT_EQ(lines, expected) << "chunk size " << chunkSize;
+        EXPECT_FALSE(log.failed());
+    }
+}
+
+TEST(CalcTest, gzipLogStopsEarly) {
+    std::string path = ::testing::TempDir() + "gzip_log_early.ibfs.gz";
+    std::string content;
+    for (int i = 0; i < 10000; ++i) {
+        content += "line " + std::to_string(i) + "\n";
+    }
+    writeGzip(path, content);
+    GzipLog log(path, 64); // the producer fills the queue and has to be stopped by the destructor
+    std::string_view line;
+    ASSERT_TRUE(log.nextLine(line));
+    EXPECT_EQ(line, "line 0");
+}
+
+TEST(CalcTest, gzipLogTruncated) {
+    std::string path = ::testing::TempDir() + "gzip_log_truncated.ibfs.gz";
+    std::string content;
+    for (int i = 0; i < 1000; ++i) {
+        content += "line " + std::to_string(i) + "\n";
+    }
+    writeGzip(path, content);
+    std::filesystem::resize_file(path, std::filesystem::file_size(path) / 2);
+    GzipLog log(path);
+    ASSERT_TRUE(log.isOpen());
+    std::string_view line;
+    while (log.nextLine(line)) {
+    }
+    EXPECT_TRUE(log.failed());
+}
+
+TEST(CalcTest, gzipLogMissingFile) {
+    GzipLog log(::testing::TempDir() + "does_not_exist.ibfs.gz");
+    EXPECT_FALSE(log.isOpen());
+    std::string_view line;
+    EXPECT_FALSE(log.nextLine(line));
+}
+
+TEST(CalcTest, stripGzipSuffix) {
+    EXPECT_TRUE(isGzipPath("log/20240520.ibfs.gz"));
+    EXPECT_FALSE(isGzipPath("log/20240520.ibfs"));
+    EXPECT_FALSE(isGzipPath(".gz"));
+    EXPECT_EQ(stripGzipSuffix("log/20240520.ibfs.gz"), "log/20240520.ibfs");
+    EXPECT_EQ(stripGzipSuffix("log/20240520.ibfs"), "log/20240520.ibfs");
+}
+
+TEST(CalcTest, parseTimeOfDay) {
+    EXPECT_EQ(parseTimeOfDay("00:00:00"), std::optional<TimeOfDay>(0));
+    EXPECT_EQ(parseTimeOfDay("09:13:06"), std::optional<TimeOfDay>(33186 * MICROS_PER_SECOND));
+    EXPECT_EQ(parseTimeOfDay("09:13:06.012430"), std::optional<TimeOfDay>(33186012430));
+    EXPECT_EQ(parseTimeOfDay("09:13:06.5"), std::optional<TimeOfDay>(33186500000));
+    EXPECT_EQ(parseTimeOfDay("09:13:06.0124309"), std::optional<TimeOfDay>(33186012430));
+    EXPECT_EQ(parseTimeOfDay("9:13:06"), std::nullopt);
+    EXPECT_EQ(parseTimeOfDay("24:00:00"), std::nullopt);
+    EXPECT_EQ(parseTimeOfDay("09:13:06."), std::nullopt);
+    EXPECT_EQ(parseTimeOfDay("09:13:06.01a"), std::nullopt);
+    EXPECT_EQ(parseTimeOfDay("09-13-06"), std::nullopt);
+}
+
+TEST(CalcTest, parseDuration) {
+    EXPECT_EQ(parseDuration("30"), std::optional<TimeOfDay>(30 * MICROS_PER_SECOND));
+    EXPECT_EQ(parseDuration("0.25"), std::optional<TimeOfDay>(250000));
+    EXPECT_EQ(parseDuration(".001"), std::optional<TimeOfDay>(1000));
+    EXPECT_EQ(parseDuration("0"), std::nullopt);
+    EXPECT_EQ(parseDuration("0.0000001"), std::nullopt);
+    EXPECT_EQ(parseDuration("-1"), std::nullopt);
+    EXPECT_EQ(parseDuration("1s"), std::nullopt);
+    EXPECT_EQ(parseDuration(""), std::nullopt);
+}
+
+TEST(CalcTest, parseDurations) {
+    std::vector<TimeOfDay> expected = {500000, 1 * MICROS_PER_SECOND, 30 * MICROS_PER_SECOND};
+    EXPECT_EQ(parseDurations("30,0.5,1,30"), std::optional<std::vector<TimeOfDay>>(expected));
+    EXPECT_EQ(parseDurations("5"), std::optional<std::vector<TimeOfDay>>(std::vector<TimeOfDay>{5 * MICROS_PER_SECOND}));
+    EXPECT_EQ(parseDurations("1,,5"), std::nullopt);
+    EXPECT_EQ(parseDurations("1,5,"), std::nullopt);
+    EXPECT_EQ(parseDurations(""), std::nullopt);
+}
+
+TEST(CalcTest, formatTimeOfDay) {
+    EXPECT_EQ(formatTimeOfDay(33186 * MICROS_PER_SECOND), "09:13:06");
+    EXPECT_EQ(formatTimeOfDay(33186012430), "09:13:06.012430");
+}
+
+TEST(CalcTest, genCheckPointsSubSecond) {
+    TimeOfDay start = parseTimeOfDay("09:00:00").value();
+    std::vector<TimeOfDay> tps = {start, start + 250000, start + 500000, start + 750000, start + MICROS_PER_SECOND};
+    EXPECT_EQ(genCheckPoints(start, start + MICROS_PER_SECOND, 250000), tps);
+    EXPECT_TRUE(genCheckPoints(start, start - 1, 250000).empty());
+    EXPECT_TRUE(genCheckPoints(start, start + 1, 0).empty());
+}
+
+TEST(CalcTest, packOrderId) {
+    EXPECT_EQ(packOrderId("g01Ot"), 0x0600'0074'4f31'3067ull);
+    EXPECT_NE(packOrderId(""), 0u);
+    EXPECT_NE(packOrderId("g01Ot"), packOrderId("g01Ou"));
+    EXPECT_NE(packOrderId("g01O"), packOrderId(std::string_view("g01O\0", 5)));
+}
+
+TEST(CalcTest, orderTableBasic) {
+    OrderTable table;
+    EXPECT_TRUE(table.empty());
+    EXPECT_TRUE(table.insert(packOrderId("g01Ot"), 223));
+    EXPECT_FALSE(table.insert(packOrderId("g01Ot"), 1)); // like unordered_map::insert, existing entry is kept
+    ASSERT_NE(table.find(packOrderId("g01Ot")), nullptr);
+    EXPECT_EQ(*table.find(packOrderId("g01Ot")), 223);
+    *table.find(packOrderId("g01Ot")) -= 100;
+    EXPECT_EQ(*table.find(packOrderId("g01Ot")), 123);
+    EXPECT_EQ(table.find(packOrderId("g01Cs")), nullptr);
+    EXPECT_FALSE(table.erase(packOrderId("g01Cs")));
+    EXPECT_TRUE(table.erase(packOrderId("g01Ot")));
+    EXPECT_EQ(table.size(), 0u);
+    EXPECT_EQ(table.find(packOrderId("g01Ot")), nullptr);
+}
+
+TEST(CalcTest, orderTableReserve) {
+    OrderTable table(1000);
+    size_t capacity = table.capacity();
+    EXPECT_GE(capacity, 2000u);
+    for (int i = 0; i < 1000; ++i) {
+        table.insert(static_cast<OrderKey>(i + 1), i);
+    }
+    EXPECT_EQ(table.capacity(), capacity); // no rehash within the reserved size
+}
+
+TEST(CalcTest, orderTableMatchesUnorderedMap) {
+    OrderTable table;
+    std::unordered_map<OrderKey, int> reference;
+    std::mt19937 rng(42);
+    for (int i = 0; i < 200000; ++i) {
+        OrderKey key = packOrderId(std::to_string(rng() % 3000));
+        switch (rng() % 3) {
+            case 0:
+                EXPECT_EQ(table.insert(key, i), reference.insert({key, i}).second);
+                break;
+            case 1:
+                EXPECT_EQ(table.erase(key), reference.erase(key) == 1);
+                break;
+            default: {
+                int* qty = table.find(key);
+                auto it = reference.find(key);
+                ASSERT_EQ(qty != nullptr, it != reference.end());
+                if (qty) {
+                    EXPECT_EQ(*qty, it->second);
+                }
+            }
+        }
+        ASSERT_EQ(table.size(), reference.size());
+    }
+}
+
+OrderEvent orderEvent(TimeOfDay time, const char* id, char status, Ticks price, int shares) {
+    OrderEvent event;
+    event.time = time;
+    event.orderId = packOrderId(id);
+    event.status = status;
+    event.price = price;
+    event.shares = shares;
+    return event;
+}
+
+TEST(CalcTest, orderReplaySamplesCheckPoints) {
+    OrderReplay replay(10, 30, {10}, 16);
+    std::vector<OrderEvent> events = {
+        orderEvent(5, "a", 'O', 100, 10),   // before the first check point
+        orderEvent(12, "b", 'O', 200, 5),
+        orderEvent(15, "a", 'M', 100, 4),   // partial fill
+        orderEvent(18, "", OrderEvent::CLOCK_ONLY, 0, 0),
+        orderEvent(25, "a", 'M', 100, 6),   // filled, no longer active
+        orderEvent(26, "c", 'C', 300, 1),   // unknown order, still counted
+        orderEvent(40, "d", 'O', 100, 1),   // past the last check point
+    };
+    for (const auto& event : events) {
+        replay.advanceTo(event.time);
+        if (replay.done())
+            break;
+        replay.apply(event);
+    }
+    EXPECT_TRUE(replay.done());
+    std::vector<ActiveOrderPair> expected = {{1, 1000}, {2, 1600}, {1, 700}};
+    ASSERT_EQ(replay.seriesCount(), 1u);
+    EXPECT_EQ(replay.series(0).checkTimes(), std::vector<TimeOfDay>({10, 20, 30}));
+    EXPECT_EQ(replay.series(0).samples(), expected);
+    EXPECT_EQ(replay.count(), 5);
+    EXPECT_EQ(replay.series(0).activeOrdersHistogram().totalCount(), 3u);
+    EXPECT_EQ(replay.series(0).amountHistogram().max(), 1600u);
+}
+
+TEST(CalcTest, orderReplaySamplesEveryInterval) {
+    OrderReplay replay(10, 30, {5, 10}, 16);
+    std::vector<OrderEvent> events = {
+        orderEvent(5, "a", 'O', 100, 10),
+        orderEvent(12, "b", 'O', 200, 5),
+        orderEvent(15, "a", 'M', 100, 4),   // at check point 15, applied before it is sampled
+        orderEvent(25, "a", 'M', 100, 6),
+        orderEvent(26, "c", 'C', 300, 1),
+        orderEvent(40, "d", 'O', 100, 1),
+    };
+    for (const auto& event : events) {
+        replay.advanceTo(event.time);
+        if (replay.done())
+            break;
+        replay.apply(event);
+    }
+    EXPECT_TRUE(replay.done());
+    ASSERT_EQ(replay.seriesCount(), 2u);
+    EXPECT_EQ(replay.series(0).interval(), 5);
+    std::vector<ActiveOrderPair> every5 = {{1, 1000}, {2, 1600}, {2, 1600}, {1, 1000}, {1, 700}};
+    std::vector<ActiveOrderPair> every10 = {{1, 1000}, {2, 1600}, {1, 700}};
+    EXPECT_EQ(replay.series(0).samples(), every5);
+    EXPECT_EQ(replay.series(1).samples(), every10);
+}
+
+TEST(CalcTest, orderReplayTracksSymbolPeaks) {
+    OrderReplay replay(10, 30, {10}, 16);
+    std::vector<OrderEvent> events = {
+        orderEvent(1, "a", 'O', 100, 10),
+        orderEvent(2, "b", 'O', 200, 5),
+        orderEvent(12, "c", 'O', 300, 2),   // symbol 0 peaks at 20 with 2 orders
+        orderEvent(13, "b", 'O', 100, 1),   // duplicate, amount counted but not the order
+        orderEvent(22, "a", 'M', 100, 10),  // filled
+        orderEvent(23, "c", 'C', 300, 2),
+        orderEvent(40, "d", 'O', 100, 1),
+    };
+    std::vector<uint32_t> symbols = {0, 1, 0, 1, 0, 0, 1};
+    for (size_t i = 0; i < events.size(); ++i) {
+        events[i].symbol = symbols[i];
+        replay.advanceTo(events[i].time);
+        if (replay.done())
+            break;
+        replay.apply(events[i]);
+    }
+    ASSERT_EQ(replay.symbols().size(), 2u);
+    EXPECT_EQ(replay.symbols()[0].activeOrders, 0);
+    EXPECT_EQ(replay.symbols()[0].amount, 0);
+    EXPECT_EQ(replay.symbols()[1].activeOrders, 1);
+    EXPECT_EQ(replay.symbols()[1].amount, 1100);
+    const std::vector<SymbolPeak>& peaks = replay.series(0).symbolPeaks();
+    ASSERT_EQ(peaks.size(), 2u);
+    EXPECT_EQ(peaks[0].amount, 1600);
+    EXPECT_EQ(peaks[0].time, 20);
+    EXPECT_EQ(peaks[0].activeOrders, 2);
+    EXPECT_EQ(peaks[1].amount, 1100);
+    EXPECT_EQ(peaks[1].time, 20);
+    EXPECT_EQ(peaks[1].activeOrders, 1);
+}
+
+TEST(CalcTest, symbolTableNumbersInOrderOfAppearance) {
+    SymbolTable symbols;
+    EXPECT_EQ(symbols.intern("5299"), 0u);
+    EXPECT_EQ(symbols.intern("2615"), 1u);
+    EXPECT_EQ(symbols.intern("5299"), 0u);
+    EXPECT_EQ(symbols.size(), 2u);
+    EXPECT_EQ(symbols.name(1), "2615");
+}
+
+TEST(CalcTest, strategyReplayPartitionsOrders) {
+    StrategyReplay replay(2, 10, 20, {10}, 16);
+    std::vector<OrderEvent> events = {
+        orderEvent(1, "a", 'O', 100, 10),
+        orderEvent(2, "b", 'O', 200, 5),
+        orderEvent(3, "c", 'O', 300, 1),
+        orderEvent(12, "a", 'M', 100, 4),  // unrouted, goes to the strategy order a is active in
+        orderEvent(13, "x", 'O', 100, 1),  // unrouted new order, ignored
+        orderEvent(30, "d", 'O', 100, 1),
+    };
+    events[1].strategy = 1;
+    events[3].strategy = OrderEvent::UNROUTED;
+    events[4].strategy = OrderEvent::UNROUTED;
+    for (const auto& event : events) {
+        replay.advanceTo(event.time);
+        if (replay.done())
+            break;
+        replay.apply(event);
+    }
+    EXPECT_TRUE(replay.done());
+    ASSERT_EQ(replay.strategyCount(), 2u);
+    std::vector<ActiveOrderPair> first = {{2, 1300}, {2, 900}};
+    std::vector<ActiveOrderPair> second = {{1, 1000}, {1, 1000}};
+    EXPECT_EQ(replay.strategy(0).series(0).samples(), first);
+    EXPECT_EQ(replay.strategy(1).series(0).samples(), second);
+    EXPECT_EQ(replay.strategy(0).count(), 3);
+    EXPECT_EQ(replay.strategy(1).count(), 1);
+}
+
+TEST(CalcTest, parseStrategyPrefixes) {
+    EXPECT_EQ(parseStrategyPrefixes("C70"), std::vector<std::string>({"C70"}));
+    EXPECT_EQ(parseStrategyPrefixes("C70,C71"), std::vector<std::string>({"C70", "C71"}));
+    EXPECT_FALSE(parseStrategyPrefixes("").has_value());
+    EXPECT_FALSE(parseStrategyPrefixes("C70,").has_value());
+    EXPECT_FALSE(parseStrategyPrefixes("C70,C70").has_value());
+    EXPECT_FALSE(parseStrategyPrefixes("C70;DROP").has_value());
+    LogStats stats{};
+    stats.tt = "ibfs";
+    EXPECT_EQ(statsTable(stats), "ibfs");
+    stats.strategy = "C70";
+    EXPECT_EQ(statsTable(stats), "ibfs_C70");
+}
+
+// A morning of new orders, cancels and fills over a handful of symbols, orders
+// and two strategies, one entry every 100ms
+std::string syntheticLog(int entries) {
+    const char* symbols[] = {"5299", "2615", "2330", "00878", "1101"};
+    const char* strategies[] = {"C703002017", "C713002017"};
+    std::string log;
+    char line[256];
+    for (int i = 0; i < entries; ++i) {
+        TimeOfDay time = parseTimeOfDay("09:05:00").value() + i * 100000LL;
+        std::string now = formatTimeOfDay(time);
+        if (now.size() == 8)
+            now += ".000000";
+        const char* symbol = symbols[i % 5];
+        const char* strategy = strategies[(i / 5) % 2];
+        int order = (i / 3) % 500;
+        switch (i % 3) {
+            case 0:
+                snprintf(line, sizeof(line), "%s 11 [Trace][][OrderReport]Tradetron 09:00:00.000 779c0098490 o%04d %s %s IntraDayOdd ROD Buy 109.5 20 0000=OrderSuccess RR\n",
+                    now.c_str(), order, strategy, symbol);
+                break;
+            case 1:
+                snprintf(line, sizeof(line), "%s 12 [Trace][][MatchReport]Tradetron 09:00:00.000 779c0098490 o%04d %s %s IntraDayOdd ROD Buy 109.5 5 RR\n",
+                    now.c_str(), order, strategy, symbol);
+                break;
+            default:
+                snprintf(line, sizeof(line), "%s 11 [Trace][][OrderUpdate]Tradetron 09:00:00.000 779c0098490 o%04d %s %s IntraDayOdd ROD Buy 109.5 15 0000=CancelSuccess RR\n",
+                    now.c_str(), order, strategy, symbol);
+                break;
+        }
+        log += line;
+    }
+    return log;
+}
+
+TEST(CalcTest, hotLoopDoesNotAllocateOnceWarm) {
+    std::string log = syntheticLog(40000); // 09:05 to about 10:12, past 4000 one second check points
+    LogFilter filter;
+    filter.strategyPrefixes = {"C70", "C71"};
+    EventParser parser("20240520.ibfs", &filter, true, true);
+    StrategyReplay replay(2, parseTimeOfDay("09:10:00").value(), parseTimeOfDay("13:24:50").value(),
+        {MICROS_PER_SECOND, 30 * MICROS_PER_SECOND}, 4096);
+    OrderEvent event;
+    size_t pos = 0;
+    size_t lines = 0;
+    size_t warmAllocations = 0;
+    while (pos < log.size()) {
+        size_t eol = log.find('\n', pos);
+        std::string_view line(log.data() + pos, eol - pos);
+        pos = eol + 1;
+        if (++lines == 10000)
+            warmAllocations = allocationCount();
+        if (!parser.read(line, event))
+            continue;
+        replay.advanceTo(event.time);
+        if (!replay.done())
+            replay.apply(event);
+    }
+    EXPECT_EQ(allocationCount() - warmAllocations, 0u) << "allocations in the 30000 lines after warming up";
+    EXPECT_GT(replay.strategy(0).count(), 0);
+    EXPECT_GT(replay.strategy(1).count(), 0);
+    EXPECT_EQ(parser.symbols().size(), 5u);
+}
+
+TEST(CalcTest, logGeneratorWritesReplayableLogs) {
+    LogGeneratorOptions options;
+    options.orders = 2000;
+    options.strategies = {"C70", "C71"};
+    options.sessionEnd = parseTimeOfDay("09:20:00").value(); // every order done long before the last check point
+    options.meanLifeSeconds = 5;
+    options.meanFills = 3;
+    options.noiseRatio = 0.5;
+    auto generate = [](const LogGeneratorOptions& options) {
+        std::vector<std::string> lines;
+        LogGenerator generator(options);
+        std::string line;
+        while (generator.nextLine(line)) {
+            lines.push_back(line);
+        }
+        return lines;
+    };
+    std::vector<std::string> lines = generate(options);
+    EXPECT_EQ(lines, generate(options)); // same seed, same log
+    LogGeneratorOptions reseeded = options;
+    reseeded.seed = 2;
+    EXPECT_NE(lines, generate(reseeded));
+
+    LogFilter filter;
+    filter.strategyPrefixes = {"C70", "C71"};
+    EventParser parser("20240520.ibfs", &filter, true, true);
+    StrategyReplay replay(2, parseTimeOfDay("09:10:00").value(), parseTimeOfDay("13:24:50").value(), {MICROS_PER_SECOND}, 4096);
+    std::ostringstream warnings;
+    StreamWarnings sink(warnings);
+    OrderEvent event;
+    TimeOfDay last = 0;
+    int orders = 0;
+    for (const auto& line : lines) {
+        if (!parser.read(line, event, sink))
+            continue;
+        EXPECT_EQ(line.substr(76, 1), line.substr(line.find("779c0098490 ") + 12, 1)); // order ID where calc reads it
+        EXPECT_GE(event.time, last);
+        last = event.time;
+        orders += event.status == 'O';
+        replay.advanceTo(event.time);
+        replay.apply(event);
+    }
+    replay.advanceTo(parseTimeOfDay("13:30:00").value());
+    EXPECT_EQ(warnings.str(), "");
+    EXPECT_EQ(orders, 2000);
+    for (size_t s = 0; s < 2; ++s) {
+        const auto& samples = replay.strategy(s).series(0).samples();
+        EXPECT_GT(replay.strategy(s).count(), 1000); // orders spread over both strategies
+        EXPECT_EQ(samples.back(), ActiveOrderPair(0, 0)); // every order filled or canceled in full
+    }
+}
+
+TEST(CalcTest, eventCacheRoundTrip) {
+    std::string path = ::testing::TempDir() + "20240520.ibfs.evc";
+    std::vector<OrderEvent> events = {
+        orderEvent(33186012430, "g01Ot", 'O', 10950, 223),
+        orderEvent(33186500000, "", OrderEvent::CLOCK_ONLY, 0, 0),
+        orderEvent(33187000000, "g01Ot", 'M', 10950, 23),  // odd count pads the shares column
+    };
+    events[2].strategy = 1;
+    events[0].symbol = 1;
+    events[2].symbol = 0;
+    EventCacheWriter writer;
+    for (const auto& event : events) {
+        writer.append(event);
+    }
+    ASSERT_TRUE(writer.write(path, "C70,C71", {"2615", "5299"})); // odd lengths pad the names
+    EventCache cache(path);
+    ASSERT_TRUE(cache.isOpen());
+    EXPECT_EQ(cache.strategies(), "C70,C71");
+    EXPECT_EQ(cache.symbolNames(), std::vector<std::string>({"2615", "5299"}));
+    ASSERT_EQ(cache.size(), events.size());
+    for (size_t i = 0; i < events.size(); ++i) {
+        OrderEvent event = cache.event(i);
+        EXPECT_EQ(event.time, events[i].time);
+        EXPECT_EQ(event.orderId, events[i].orderId);
+        EXPECT_EQ(event.status, events[i].status);
+        EXPECT_EQ(event.price, events[i].price);
+        EXPECT_EQ(event.shares, events[i].shares);
+        EXPECT_EQ(event.strategy, events[i].strategy);
+        EXPECT_EQ(event.symbol, events[i].symbol);
+    }
+}
+
+TEST(CalcTest, eventCacheRejectsBadFiles) {
+    std::string path = ::testing::TempDir() + "bad.ibfs.evc";
+    EventCacheWriter writer;
+    writer.append(orderEvent(1, "a", 'O', 1, 1));
+    ASSERT_TRUE(writer.write(path, ""));
+    EXPECT_TRUE(EventCache(path).isOpen());
+    std::filesystem::resize_file(path, std::filesystem::file_size(path) - 1);
+    EXPECT_FALSE(EventCache(path).isOpen()); // truncated
+    {
+        std::ofstream out(path);
+        out << "09:13:06.012430 11 [Trace][][OrderReport]Tradetron 09:13:06.011 779c0098490 g01Ot C703002017\n";
+    }
+    EXPECT_FALSE(EventCache(path).isOpen()); // a text log
+    EXPECT_FALSE(EventCache(::testing::TempDir() + "does_not_exist.evc").isOpen());
+    EXPECT_EQ(eventCachePath("log/20240520.ibfs.gz"), "log/20240520.ibfs.evc");
+    EXPECT_EQ(stripEventCacheSuffix("log/20240520.ibfs.evc"), "log/20240520.ibfs");
+}
+
+TEST(CalcTest, computePercentilesMedian) {
+    std::vector<int> even = {4, 1, 3, 2};
+    EXPECT_EQ(computePercentiles(even, {50}), std::vector<double>({2.5}));
+    std::vector<int> odd = {5, 1, 4, 2, 3};
+    EXPECT_EQ(computePercentiles(odd, {50}), std::vector<double>({3}));
+    std::vector<int> single = {7};
+    EXPECT_EQ(computePercentiles(single, {0, 50, 100}), std::vector<double>({7, 7, 7}));
+    std::vector<int> empty;
+    EXPECT_EQ(computePercentiles(empty, {50, 99}), std::vector<double>({0, 0}));
+}
+
+TEST(CalcTest, computePercentilesMatchesSort) {
+    std::mt19937 rng(7);
+    std::vector<double> values(1001);
+    for (auto& v : values) {
+        v = rng() % 10000;
+    }
+    std::vector<double> sorted = values;
+    std::sort(sorted.begin(), sorted.end());
+    // unordered request, duplicates and extremes
+    std::vector<double> wanted = {99.9, 50, 0, 90, 100, 50, 99};
+    std::vector<double> result = computePercentiles(values, wanted);
+    for (size_t i = 0; i < wanted.size(); ++i) {
+        double rank = wanted[i] / 100.0 * (sorted.size() - 1);
+        size_t lo = static_cast<size_t>(rank);
+        double expected = sorted[lo];
+        if (lo + 1 < sorted.size()) {
+            expected += (rank - lo) * (sorted[lo + 1] - sorted[lo]);
+        }
+        EXPECT_DOUBLE_EQ(result[i], expected) << wanted[i];
+    }
+}
+
+TEST(CalcTest, parsePercentiles) {
+    EXPECT_EQ(parsePercentiles("50,90,99,99.9"), std::optional<std::vector<double>>({50, 90, 99, 99.9}));
+    EXPECT_EQ(parsePercentiles("100"), std::optional<std::vector<double>>(std::vector<double>{100}));
+    EXPECT_EQ(parsePercentiles(""), std::nullopt);
+    EXPECT_EQ(parsePercentiles("50,"), std::nullopt);
+    EXPECT_EQ(parsePercentiles("50,abc"), std::nullopt);
+    EXPECT_EQ(parsePercentiles("101"), std::nullopt);
+}
+
+TEST(CalcTest, percentileColumn) {
+    EXPECT_EQ(percentileColumn(50, "ActiveOrders"), "p50ActiveOrders");
+    EXPECT_EQ(percentileColumn(99.9, "Amount"), "p99_9Amount");
+}
+
+TEST(CalcTest, histogramSmallValuesExact) {
+    LogLinearHistogram histogram;
+    for (int v = 1; v <= 100; ++v) {
+        histogram.record(v);
+    }
+    EXPECT_EQ(histogram.totalCount(), 100u);
+    EXPECT_EQ(histogram.max(), 100u);
+    EXPECT_EQ(histogram.valueAtPercentile(50), 50u);
+    EXPECT_EQ(histogram.valueAtPercentile(99), 99u);
+    EXPECT_EQ(histogram.valueAtPercentile(100), 100u);
+    EXPECT_EQ(histogram.valueAtPercentile(0), 1u);
+    EXPECT_EQ(LogLinearHistogram().valueAtPercentile(50), 0u);
+}
+
+TEST(CalcTest, histogramLargeValuesWithinPrecision) {
+    LogLinearHistogram histogram;
+    std::mt19937_64 rng(3);
+    std::vector<int64_t> values(10000);
+    for (auto& v : values) {
+        v = static_cast<int64_t>(rng() % 1000000000);
+        histogram.record(v);
+    }
+    std::sort(values.begin(), values.end());
+    for (double p : {50.0, 90.0, 99.0, 99.9}) {
+        double exact = values[static_cast<size_t>(p / 100.0 * values.size() + 0.5) - 1];
+        double approx = histogram.valueAtPercentile(p);
+        EXPECT_GE(approx, exact) << p;
+        EXPECT_LE(approx, exact * (1 + 1.0 / 64)) << p;
+    }
+}
+
+TEST(CalcTest, histogramMergeAndSerialize) {
+    LogLinearHistogram day1, day2, both;
+    for (int v = 0; v < 5000; v += 7) {
+        day1.record(v * 1000);
+        both.record(v * 1000);
+    }
+    for (int v = 0; v < 300; ++v) {
+        day2.record(v, 2);
+        both.record(v, 2);
+    }
+    std::vector<uint8_t> blob1 = day1.serialize();
+    std::vector<uint8_t> blob2 = day2.serialize();
+    auto merged = LogLinearHistogram::deserialize(blob1.data(), blob1.size());
+    ASSERT_TRUE(merged.has_value());
+    merged->merge(LogLinearHistogram::deserialize(blob2.data(), blob2.size()).value());
+    EXPECT_EQ(merged->serialize(), both.serialize());
+    EXPECT_EQ(merged->totalCount(), both.totalCount());
+    EXPECT_EQ(merged->max(), 4998000u);
+
+    std::vector<uint8_t> garbage = {'n', 'o', 'p', 'e'};
+    EXPECT_FALSE(LogLinearHistogram::deserialize(garbage.data(), garbage.size()).has_value());
+    EXPECT_FALSE(LogLinearHistogram::deserialize(nullptr, 0).has_value());
+    blob1.pop_back();
+    EXPECT_FALSE(LogLinearHistogram::deserialize(blob1.data(), blob1.size()).has_value());
+}
+
+TEST(CalcTest, parsePriceTicks) {
+    EXPECT_EQ(parsePriceTicks("109.5"), std::optional<Ticks>(10950));
+    EXPECT_EQ(parsePriceTicks("63.8"), std::optional<Ticks>(6380));
+    EXPECT_EQ(parsePriceTicks("1000"), std::optional<Ticks>(100000));
+    EXPECT_EQ(parsePriceTicks("0.01"), std::optional<Ticks>(1));
+    EXPECT_EQ(parsePriceTicks(".5"), std::optional<Ticks>(50));
+    EXPECT_EQ(parsePriceTicks("12."), std::optional<Ticks>(1200));
+    EXPECT_EQ(parsePriceTicks("63.805"), std::optional<Ticks>(6381)); // rounds like std::round(price * 100)
+    EXPECT_EQ(parsePriceTicks("63.8049"), std::optional<Ticks>(6380));
+    EXPECT_EQ(parsePriceTicks(""), std::nullopt);
+    EXPECT_EQ(parsePriceTicks("."), std::nullopt);
+    EXPECT_EQ(parsePriceTicks("-1"), std::nullopt);
+    EXPECT_EQ(parsePriceTicks("1.2.3"), std::nullopt);
+    EXPECT_EQ(parsePriceTicks("12a"), std::nullopt);
+    EXPECT_EQ(parsePriceTicks("9999999999999999.9"), std::optional<Ticks>(999999999999999990)); // 16 integer digits at most
+    EXPECT_EQ(parsePriceTicks("1.0000000000000000000"), std::optional<Ticks>(100)); // any number of fraction digits
+    EXPECT_EQ(parsePriceTicks("0.0049999999999999999"), std::optional<Ticks>(0));
+    EXPECT_EQ(parsePriceTicks("99999999999999999"), std::nullopt);  // 17 integer digits
+    EXPECT_EQ(parsePriceTicks("999999999999999999"), std::nullopt); // a garbled field, would overflow
+}
+
+TEST(CalcTest, parseUnsigned) {
+    EXPECT_EQ(parseUnsigned<int>("223"), std::optional<int>(223));
+    EXPECT_EQ(parseUnsigned<int>("0"), std::optional<int>(0));
+    EXPECT_EQ(parseUnsigned<int>("20240520"), std::optional<int>(20240520));
+    EXPECT_EQ(parseUnsigned<int>(""), std::nullopt);
+    EXPECT_EQ(parseUnsigned<int>("-5"), std::nullopt);
+    EXPECT_EQ(parseUnsigned<int>("+5"), std::nullopt);
+    EXPECT_EQ(parseUnsigned<int>(" 5"), std::nullopt);
+    EXPECT_EQ(parseUnsigned<int>("22x"), std::nullopt);
+    EXPECT_EQ(parseUnsigned<int>("99999999999"), std::nullopt); // does not fit
+    EXPECT_EQ(parseUnsigned<size_t>("99999999999"), std::optional<size_t>(99999999999ull));
+    // only the view is read, not up to a terminator
+    std::string_view qty = std::string_view("2234 0000=OrderSuccess").substr(0, 3);
+    EXPECT_EQ(parseUnsigned<int>(qty), std::optional<int>(223));
+}
+
+TEST(CalcTest, ticksAmountIsExact) {
+    // 0.1 + 0.2 style drift does not happen with ticks: a million fills of 63.8 x 999 cancel out exactly
+    Ticks amount = 0;
+    Ticks price = parsePriceTicks("63.8").value();
+    for (int i = 0; i < 1000000; ++i) {
+        amount += price * 999;
+    }
+    for (int i = 0; i < 1000000; ++i) {
+        amount -= price * 999;
+    }
+    EXPECT_EQ(amount, 0);
+    EXPECT_DOUBLE_EQ(ticksToUnits(10950), 109.5);
+}
+
+// number of rows in table <tb_name>, -1 on error
+int countRows(const std::string& path, const std::string& tb_name) {
+    sqlite3* db;
+    sqlite3_stmt* stmt;
+    int count = -1;
+    sqlite3_open(path.c_str(), &db);
+    if (sqlite3_prepare_v2(db, ("SELECT COUNT(*) FROM " + tb_name).c_str(), -1, &stmt, nullptr) == SQLITE_OK) {
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            count = sqlite3_column_int(stmt, 0);
+        }
+        sqlite3_finalize(stmt);
+    }
+    sqlite3_close(db);
+    return count;
+}
+
+TEST(CalcTest, logStatsWriterBatches) {
+    std::string path = ::testing::TempDir() + "log_stats_writer.db";
+    std::remove(path.c_str());
+    LogStats stats{};
+    stats.tt = "ibfs";
+    {
+        LogStatsWriter writer(2);
+        ASSERT_TRUE(writer.open(path)) << writer.lastError();
+        for (int date = 20240101; date < 20240104; ++date) {
+            stats.date = date;
+            EXPECT_TRUE(writer.insert(stats, "ibfs")) << writer.lastError();
+        }
+        EXPECT_EQ(countRows(path, "ibfs"), 2); // first batch committed, third row still pending
+        stats.date = 20240101;
+        EXPECT_TRUE(writer.insert(stats, "ibfs")); // replaces the existing day
+        EXPECT_TRUE(writer.commit());
+        EXPECT_EQ(countRows(path, "ibfs"), 3);
+        stats.date = 20240105;
+        EXPECT_TRUE(writer.insert(stats, "ibfs"));
+    }
+    EXPECT_EQ(countRows(path, "ibfs"), 4); // pending rows committed on destruction
+}
+
+TEST(CalcTest, logStatsWriterAddsPercentileColumns) {
+    std::string path = ::testing::TempDir() + "log_stats_writer_percentiles.db";
+    std::remove(path.c_str());
+    LogStats stats{};
+    stats.tt = "ibfs";
+    stats.date = 20240101;
+    LogStatsWriter writer;
+    ASSERT_TRUE(writer.open(path));
+    EXPECT_TRUE(writer.insert(stats, "ibfs")); // table without percentile columns
+    stats.date = 20240102;
+    stats.percentiles = {50, 99.9};
+    stats.activeOrdersPercentiles = {10, 20};
+    stats.amountPercentiles = {100000, 200000}; // ticks, stored as 1000 and 2000
+    EXPECT_TRUE(writer.insert(stats, "ibfs")) << writer.lastError();
+    EXPECT_TRUE(writer.close());
+    EXPECT_EQ(countRows(path, "ibfs WHERE p99_9Amount = 2000 AND p50ActiveOrders = 10"), 1);
+}
+
+TEST(CalcTest, logStatsWriterKeysByInterval) {
+    std::string path = ::testing::TempDir() + "log_stats_writer_interval.db";
+    std::remove(path.c_str());
+    {
+        // a table from before the interval was stored, keyed by date alone
+        sqlite3* db;
+        ASSERT_EQ(sqlite3_open(path.c_str(), &db), SQLITE_OK);
+        ASSERT_EQ(sqlite3_exec(db, "CREATE TABLE ibfs (date INT PRIMARY KEY, tt TEXT, numberOfLogs INT, p99Amount REAL);"
+            "INSERT INTO ibfs VALUES (20240101, 'ibfs', 7, 1.5);", nullptr, nullptr, nullptr), SQLITE_OK);
+        sqlite3_close(db);
+    }
+    LogStats stats{};
+    stats.tt = "ibfs";
+    stats.date = 20240101;
+    {
+        LogStatsWriter writer;
+        ASSERT_TRUE(writer.open(path)) << writer.lastError();
+        for (double interval : {1.0, 30.0, 1.0}) {
+            stats.intervalSeconds = interval;
+            EXPECT_TRUE(writer.insert(stats, "ibfs")) << writer.lastError();
+        }
+    }
+    EXPECT_EQ(countRows(path, "ibfs"), 3); // the old row plus one per interval
+
+    sqlite3* db;
+    sqlite3_stmt* stmt;
+    ASSERT_EQ(sqlite3_open(path.c_str(), &db), SQLITE_OK);
+    ASSERT_EQ(sqlite3_prepare_v2(db, "SELECT numberOfLogs, p99Amount FROM ibfs WHERE intervalSeconds IS NULL", -1, &stmt, nullptr), SQLITE_OK);
+    ASSERT_EQ(sqlite3_step(stmt), SQLITE_ROW);
+    EXPECT_EQ(sqlite3_column_int(stmt, 0), 7);
+    EXPECT_DOUBLE_EQ(sqlite3_column_double(stmt, 1), 1.5);
+    sqlite3_finalize(stmt);
+    sqlite3_close(db);
+}
+
+TEST(CalcTest, selectHistogramsPrefersRowsAtTheInterval) {
+    std::string path = ::testing::TempDir() + "select_histograms.db";
+    std::remove(path.c_str());
+    {
+        // two days from before the interval was stored
+        sqlite3* db;
+        ASSERT_EQ(sqlite3_open(path.c_str(), &db), SQLITE_OK);
+        ASSERT_EQ(sqlite3_exec(db, "CREATE TABLE ibfs (date INT PRIMARY KEY, tt TEXT, numberOfLogs INT);"
+            "INSERT INTO ibfs VALUES (20240101, 'ibfs', 7), (20240102, 'ibfs', 8);", nullptr, nullptr, nullptr), SQLITE_OK);
+        sqlite3_close(db);
+    }
+    LogStats stats{};
+    stats.tt = "ibfs";
+    stats.date = 20240101; // rerun at one second, next to its old row
+    stats.intervalSeconds = 1;
+    stats.numberOfLogs = 9;
+    ASSERT_EQ(write2db(stats, "ibfs", path), 0);
+
+    sqlite3* db;
+    sqlite3_stmt* stmt;
+    ASSERT_EQ(sqlite3_open(path.c_str(), &db), SQLITE_OK);
+    std::string sql = "SELECT date, (SELECT numberOfLogs FROM ibfs WHERE date = merged.date AND intervalSeconds IS ?3) FROM (" +
+        selectHistogramsSQL("ibfs") + ") AS merged";
+    ASSERT_EQ(sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr), SQLITE_OK) << sqlite3_errmsg(db);
+    auto select = [&](double intervalSeconds) {
+        std::vector<std::pair<int, int>> days;
+        sqlite3_bind_int(stmt, 1, 20240101);
+        sqlite3_bind_int(stmt, 2, 20240131);
+        sqlite3_bind_double(stmt, 3, intervalSeconds);
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            days.emplace_back(sqlite3_column_int(stmt, 0), sqlite3_column_type(stmt, 1) == SQLITE_NULL ? 0 : sqlite3_column_int(stmt, 1));
+        }
+        sqlite3_reset(stmt);
+        return days;
+    };
+    // 20240101 once, from its row at the interval, 20240102 from its old row
+    EXPECT_EQ(select(1), (std::vector<std::pair<int, int>>{{20240101, 9}, {20240102, 0}}));
+    EXPECT_EQ(select(30), (std::vector<std::pair<int, int>>{{20240101, 0}, {20240102, 0}}));
+    sqlite3_finalize(stmt);
+    sqlite3_close(db);
+}
+
+TEST(CalcTest, logStatsWriterStoresTopSymbols) {
+    std::string path = ::testing::TempDir() + "log_stats_writer_symbols.db";
+    std::remove(path.c_str());
+    LogStats stats{};
+    stats.tt = "ibfs";
+    stats.date = 20240101;
+    stats.intervalSeconds = 30;
+    stats.topSymbols = {{"5299", 10950, "09:10:30", 2}, {"2615", 6380, "09:11:00", 1}};
+    {
+        LogStatsWriter writer;
+        ASSERT_TRUE(writer.open(path)) << writer.lastError();
+        EXPECT_TRUE(writer.insert(stats, "ibfs")) << writer.lastError();
+        stats.topSymbols.pop_back(); // a rerun of the same day replaces its symbols
+        EXPECT_TRUE(writer.insert(stats, "ibfs")) << writer.lastError();
+        stats.intervalSeconds = 1;
+        EXPECT_TRUE(writer.insert(stats, "ibfs")) << writer.lastError();
+    }
+    EXPECT_EQ(countRows(path, "ibfs_symbols"), 2);
+
+    sqlite3* db;
+    sqlite3_stmt* stmt;
+    ASSERT_EQ(sqlite3_open(path.c_str(), &db), SQLITE_OK);
+    ASSERT_EQ(sqlite3_prepare_v2(db, "SELECT rank, symbol, peakAmount, peakTime, activeOrders FROM ibfs_symbols WHERE intervalSeconds = 30", -1, &stmt, nullptr), SQLITE_OK);
+    ASSERT_EQ(sqlite3_step(stmt), SQLITE_ROW);
+    EXPECT_EQ(sqlite3_column_int(stmt, 0), 1);
+    EXPECT_STREQ(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1)), "5299");
+    EXPECT_DOUBLE_EQ(sqlite3_column_double(stmt, 2), 109.5);
+    EXPECT_STREQ(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3)), "09:10:30");
+    EXPECT_EQ(sqlite3_column_int(stmt, 4), 2);
+    EXPECT_EQ(sqlite3_step(stmt), SQLITE_DONE);
+    sqlite3_finalize(stmt);
+    sqlite3_close(db);
+}
+
+TEST(CalcTest, logStatsWriterStoresSeries) {
+    std::string path = ::testing::TempDir() + "log_stats_writer_series.db";
+    std::remove(path.c_str());
+    LogStats stats{};
+    stats.tt = "ibfs";
+    stats.date = 20240101;
+    stats.intervalSeconds = 1;
+    for (int i = 0; i < 300; ++i) { // two full multi-row inserts and a remainder
+        stats.series.push_back(CheckPointSample{33000.0 + i, i, i * 100});
+    }
+    {
+        LogStatsWriter writer;
+        ASSERT_TRUE(writer.open(path)) << writer.lastError();
+        EXPECT_TRUE(writer.insert(stats, "ibfs")) << writer.lastError();
+        EXPECT_TRUE(writer.insert(stats, "ibfs")) << writer.lastError(); // replaces the series of the day
+    }
+    EXPECT_EQ(countRows(path, "ibfs_series"), 300);
+
+    sqlite3* db;
+    sqlite3_stmt* stmt;
+    ASSERT_EQ(sqlite3_open(path.c_str(), &db), SQLITE_OK);
+    ASSERT_EQ(sqlite3_prepare_v2(db, "SELECT activeOrders, amount FROM ibfs_series WHERE checkTime = 33299", -1, &stmt, nullptr), SQLITE_OK);
+    ASSERT_EQ(sqlite3_step(stmt), SQLITE_ROW);
+    EXPECT_EQ(sqlite3_column_int(stmt, 0), 299);
+    EXPECT_DOUBLE_EQ(sqlite3_column_double(stmt, 1), 299.0);
+    sqlite3_finalize(stmt);
+    sqlite3_close(db);
+}
+
+// the non-NULL values of <column> in the rows of <tb_name> sampled every <intervalSeconds>
+std::vector<double> columnValues(const std::string& path, const std::string& tb_name, const std::string& column, double intervalSeconds) {
+    sqlite3* db;
+    sqlite3_stmt* stmt;
+    std::vector<double> values;
+    sqlite3_open(path.c_str(), &db);
+    std::string sql = "SELECT " + column + " FROM " + tb_name + " WHERE intervalSeconds = ? AND " + column + " IS NOT NULL";
+    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr) == SQLITE_OK) {
+        sqlite3_bind_double(stmt, 1, intervalSeconds);
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            values.push_back(sqlite3_column_double(stmt, 0));
+        }
+        sqlite3_finalize(stmt);
+    }
+    sqlite3_close(db);
+    return values;
+}
+
+// the percentiles of <metric> in the percentilesTable() of <tb_name>, NaN if not there
+std::vector<double> storedPercentiles(const std::string& path, const std::string& tb_name, const std::string& metric,
+    double intervalSeconds, const std::vector<double>& percentiles) {
+    sqlite3* db;
+    sqlite3_stmt* stmt;
+    std::vector<double> values(percentiles.size(), std::nan(""));
+    sqlite3_open(path.c_str(), &db);
+    std::string sql = "SELECT value FROM " + percentilesTable(tb_name) + " WHERE metric = ? AND intervalSeconds = ? AND percentile = ?";
+    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr) == SQLITE_OK) {
+        for (size_t i = 0; i < percentiles.size(); ++i) {
+            sqlite3_bind_text(stmt, 1, metric.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_double(stmt, 2, intervalSeconds);
+            sqlite3_bind_double(stmt, 3, percentiles[i]);
+            if (sqlite3_step(stmt) == SQLITE_ROW)
+                values[i] = sqlite3_column_double(stmt, 0);
+            sqlite3_reset(stmt);
+        }
+        sqlite3_finalize(stmt);
+    }
+    sqlite3_close(db);
+    return values;
+}
+
+TEST(CalcTest, logStatsWriterKeepsCrossDayPercentiles) {
+    std::string path = ::testing::TempDir() + "log_stats_writer_percentiles.db";
+    std::remove(path.c_str());
+    std::mt19937 random(11);
+    LogStats stats{};
+    stats.tt = "ibfs";
+    stats.percentiles = {50, 99};
+    auto randomDay = [&](int date, double intervalSeconds) {
+        stats.date = date;
+        stats.intervalSeconds = intervalSeconds;
+        stats.numberOfLogs = static_cast<int>(random() % 5); // plenty of ties
+        stats.maxActiveOrders = static_cast<int>(random() % 3000);
+        stats.maxAmount = static_cast<Ticks>(random() % 100000000);
+        stats.meanAmount = static_cast<double>(random() % 1000000);
+        stats.activeOrdersPercentiles = {static_cast<double>(random() % 100), static_cast<double>(random() % 1000)};
+        stats.amountPercentiles = {static_cast<double>(random() % 100000), static_cast<double>(random() % 1000000)};
+    };
+    auto expectExact = [&](const std::vector<double>& percentiles) {
+        for (const char* metric : {"numberOfLogs", "maxActiveOrders", "maxAmount", "meanAmount", "p50ActiveOrders", "p99Amount"}) {
+            for (double interval : {1.0, 30.0}) {
+                std::vector<double> values = columnValues(path, "ibfs", metric, interval);
+                ASSERT_FALSE(values.empty());
+                std::vector<double> expected = computePercentiles(values, percentiles);
+                std::vector<double> stored = storedPercentiles(path, "ibfs", metric, interval, percentiles);
+                for (size_t i = 0; i < percentiles.size(); ++i) {
+                    EXPECT_NEAR(stored[i], expected[i], 1e-6 * std::max(1.0, std::fabs(expected[i])))
+                        << metric << " p" << percentiles[i] << " every " << interval << "s";
+                }
+            }
+        }
+    };
+
+    {
+        LogStatsWriter writer(16);
+        ASSERT_TRUE(writer.open(path)) << writer.lastError();
+        for (int i = 0; i < 300; ++i) {
+            randomDay(20240101 + static_cast<int>(random() % 200), i % 3 == 0 ? 1 : 30); // reruns replace a day
+            ASSERT_TRUE(writer.insert(stats, "ibfs")) << writer.lastError();
+        }
+        stats.percentiles = {50}; // a rerun without the 99th percentile columns drops them
+        randomDay(20240101, 30);
+        stats.activeOrdersPercentiles.pop_back();
+        stats.amountPercentiles.pop_back();
+        ASSERT_TRUE(writer.insert(stats, "ibfs")) << writer.lastError();
+        ASSERT_TRUE(writer.close()) << writer.lastError();
+    }
+    expectExact({50, 99});
+
+    // a new percentile is tracked from the first row asking for it, rolled back rows leave no trace
+    {
+        LogStatsWriter writer;
+        ASSERT_TRUE(writer.open(path)) << writer.lastError();
+        stats.percentiles = {50, 75, 99};
+        randomDay(20240301, 30);
+        stats.activeOrdersPercentiles = {1, 2, 3};
+        stats.amountPercentiles = {4, 5, 6};
+        ASSERT_TRUE(writer.insert(stats, "ibfs")) << writer.lastError();
+        ASSERT_TRUE(writer.rollback());
+        randomDay(20240302, 1);
+        stats.activeOrdersPercentiles = {1, 2, 3};
+        stats.amountPercentiles = {4, 5, 6};
+        ASSERT_TRUE(writer.insert(stats, "ibfs")) << writer.lastError();
+        randomDay(20240302, 30);
+        stats.activeOrdersPercentiles = {1, 2, 3};
+        stats.amountPercentiles = {4, 5, 6};
+        ASSERT_TRUE(writer.insert(stats, "ibfs")) << writer.lastError();
+    }
+    expectExact({50, 75, 99});
+
+    // tables stored before the percentiles were kept get them from their rows
+    sqlite3* db;
+    ASSERT_EQ(sqlite3_open(path.c_str(), &db), SQLITE_OK);
+    ASSERT_EQ(sqlite3_exec(db, "DROP TABLE ibfs_sorted; DROP TABLE ibfs_percentiles", nullptr, nullptr, nullptr), SQLITE_OK);
+    sqlite3_close(db);
+    {
+        LogStatsWriter writer;
+        ASSERT_TRUE(writer.open(path)) << writer.lastError();
+        stats.percentiles = {50, 99};
+        for (double interval : {1.0, 30.0}) {
+            randomDay(20240401, interval);
+            ASSERT_TRUE(writer.insert(stats, "ibfs")) << writer.lastError();
+        }
+    }
+    expectExact({50, 99});
+}
+
+TEST(CalcTest, logStatsWriterKeepsMedianOfRowsWithoutInterval) {
+    std::string path = ::testing::TempDir() + "log_stats_writer_legacy_percentiles.db";
+    std::remove(path.c_str());
+    auto exec = [&](const std::string& sql) {
+        sqlite3* db;
+        ASSERT_EQ(sqlite3_open(path.c_str(), &db), SQLITE_OK);
+        EXPECT_EQ(sqlite3_exec(db, sql.c_str(), nullptr, nullptr, nullptr), SQLITE_OK) << sqlite3_errmsg(db);
+        sqlite3_close(db);
+    };
+    // days from before the interval was stored, one without a maxAmount
+    exec("CREATE TABLE ibfs (date INT PRIMARY KEY, tt TEXT, numberOfLogs INT, maxAmount REAL);"
+        "INSERT INTO ibfs VALUES (20240101, 'ibfs', 7, 500), (20240102, 'ibfs', 8, 100), (20240103, 'ibfs', 6, 400),"
+        " (20240104, 'ibfs', 9, 200), (20240105, 'ibfs', 5, NULL)");
+    LogStats stats{};
+    stats.tt = "ibfs";
+    stats.date = 20240106;
+    stats.intervalSeconds = 30;
+    stats.numberOfLogs = 100;
+    stats.maxAmount = 100000;
+    ASSERT_EQ(write2db(stats, "ibfs", path), 0);
+    auto expectLegacyMedians = [&]() {
+        EXPECT_EQ(storedPercentiles(path, "ibfs", "maxAmount", LEGACY_INTERVAL_SECONDS, {50}), std::vector<double>{300});
+        EXPECT_EQ(storedPercentiles(path, "ibfs", "numberOfLogs", LEGACY_INTERVAL_SECONDS, {50}), std::vector<double>{7});
+        EXPECT_EQ(countRows(path, "ibfs_sorted WHERE intervalSeconds = 0 AND metric = 'maxAmount'"), 4);
+    };
+    expectLegacyMedians();
+    EXPECT_EQ(storedPercentiles(path, "ibfs", "maxAmount", 30, {50}), std::vector<double>{1000});
+
+    // a database whose percentiles were kept without them gets them on the next day stored, once
+    exec("DELETE FROM ibfs_sorted WHERE intervalSeconds = 0; DELETE FROM ibfs_percentiles WHERE intervalSeconds = 0");
+    for (int date : {20240107, 20240108}) {
+        stats.date = date;
+        ASSERT_EQ(write2db(stats, "ibfs", path), 0);
+        expectLegacyMedians();
+    }
+}
+
+TEST(CalcTest, logStatsWriterRollsBackFailedRow) {
+    std::string path = ::testing::TempDir() + "log_stats_writer_failed_row.db";
+    std::remove(path.c_str());
+    LogStats stats{};
+    stats.tt = "ibfs";
+    stats.date = 20240101;
+    stats.intervalSeconds = 30;
+    stats.maxAmount = 10000;
+    stats.topSymbols = {{"5299", 10000, "09:10:30", 2}};
+    ASSERT_EQ(write2db(stats, "ibfs", path), 0);
+
+    // the top symbols are stored after the row itself and its percentiles, make them fail
+    sqlite3* db;
+    ASSERT_EQ(sqlite3_open(path.c_str(), &db), SQLITE_OK);
+    ASSERT_EQ(sqlite3_exec(db, "CREATE TRIGGER no_symbols BEFORE INSERT ON ibfs_symbols BEGIN SELECT RAISE(ABORT, 'no symbols'); END",
+        nullptr, nullptr, nullptr), SQLITE_OK);
+    sqlite3_close(db);
+    stats.maxAmount = 20000;
+    EXPECT_EQ(write2db(stats, "ibfs", path), 1);
+    EXPECT_EQ(columnValues(path, "ibfs", "maxAmount", 30), std::vector<double>{100});
+    EXPECT_EQ(storedPercentiles(path, "ibfs", "maxAmount", 30, {50}), std::vector<double>{100});
+    EXPECT_EQ(countRows(path, "ibfs_symbols"), 1);
+
+    // within a batch, the rows before the failed one are still committed
+    {
+        LogStatsWriter writer;
+        ASSERT_TRUE(writer.open(path)) << writer.lastError();
+        LogStats other = stats;
+        other.date = 20240102;
+        other.maxAmount = 30000;
+        other.topSymbols.clear();
+        EXPECT_TRUE(writer.insert(other, "ibfs")) << writer.lastError();
+        stats.date = 20240103;
+        EXPECT_FALSE(writer.insert(stats, "ibfs"));
+        EXPECT_NE(writer.lastError().find("no symbols"), std::string::npos);
+    }
+    std::vector<double> amounts = columnValues(path, "ibfs", "maxAmount", 30);
+    std::sort(amounts.begin(), amounts.end());
+    EXPECT_EQ(amounts, (std::vector<double>{100, 300}));
+    EXPECT_EQ(storedPercentiles(path, "ibfs", "maxAmount", 30, {50}), std::vector<double>{200});
+    EXPECT_EQ(countRows(path, "ibfs_symbols"), 1);
+}
+
+TEST(CalcTest, logStatsWriterRollsBackFailedCommit) {
+    std::string path = ::testing::TempDir() + "log_stats_writer_failed_commit.db";
+    std::remove(path.c_str());
+    LogStats stats{};
+    stats.tt = "ibfs";
+    stats.date = 20240101;
+    stats.intervalSeconds = 30;
+    stats.maxAmount = 10000;
+    ASSERT_EQ(write2db(stats, "ibfs", path), 0);
+
+    // a deferred foreign key is only checked by COMMIT
+    LogStatsWriter writer(2);
+    ASSERT_TRUE(writer.open(path)) << writer.lastError();
+    ASSERT_TRUE(writer.exec("PRAGMA foreign_keys = ON"));
+    ASSERT_TRUE(writer.exec("CREATE TABLE parent (date INTEGER PRIMARY KEY)"));
+    ASSERT_TRUE(writer.exec("CREATE TABLE child (date INTEGER REFERENCES parent (date) DEFERRABLE INITIALLY DEFERRED)"));
+    ASSERT_TRUE(writer.exec("CREATE TRIGGER orphan AFTER INSERT ON ibfs BEGIN INSERT INTO child VALUES (NEW.date); END"));
+    stats.date = 20240102;
+    stats.maxAmount = 20000;
+    EXPECT_TRUE(writer.insert(stats, "ibfs")) << writer.lastError();
+    stats.date = 20240103;
+    stats.maxAmount = 30000;
+    EXPECT_FALSE(writer.insert(stats, "ibfs"));
+    EXPECT_NE(writer.lastError().find("FOREIGN KEY"), std::string::npos) << writer.lastError();
+    EXPECT_EQ(columnValues(path, "ibfs", "maxAmount", 30), std::vector<double>{100});
+    EXPECT_EQ(storedPercentiles(path, "ibfs", "maxAmount", 30, {50}), std::vector<double>{100});
+
+    // the percentiles of the rolled back rows are not carried into the next commit
+    ASSERT_TRUE(writer.exec("DROP TRIGGER orphan"));
+    stats.date = 20240104;
+    stats.maxAmount = 50000;
+    EXPECT_TRUE(writer.insert(stats, "ibfs")) << writer.lastError();
+    EXPECT_TRUE(writer.close()) << writer.lastError();
+    std::vector<double> amounts = columnValues(path, "ibfs", "maxAmount", 30);
+    std::sort(amounts.begin(), amounts.end());
+    EXPECT_EQ(amounts, (std::vector<double>{100, 500}));
+    EXPECT_EQ(storedPercentiles(path, "ibfs", "maxAmount", 30, {50}), std::vector<double>{300});
+}
+
+TEST(CalcTest, logStatsWriterReportsErrors) {
+    LogStatsWriter writer;
+    LogStats stats{};
+    EXPECT_FALSE(writer.insert(stats, "ibfs"));
+    EXPECT_FALSE(writer.lastError().empty());
+
+    EXPECT_FALSE(writer.open(::testing::TempDir() + "no/such/dir/out.db"));
+    ASSERT_TRUE(writer.open(":memory:"));
+    EXPECT_FALSE(writer.insert(stats, "not a table name"));
+    EXPECT_NE(writer.lastError().find("not a table name"), std::string::npos);
+    EXPECT_TRUE(writer.insert(stats, "ibfs")); // still usable after an error
+    EXPECT_TRUE(writer.close());
+}
+
+TEST(CalcTest, eventParserCountsLinesAndWarnings) {
+    LogFilter filter;
+    EventParser parser("20240520.ibfs", &filter, false, false);
+    std::ostringstream warnings;
+    StreamWarnings sink(warnings);
+    OrderEvent event;
+    const char* lines[] = {
+        "09:13:06.012430 11 [Trace][][OrderReport]Tradetron",  // too short
+        "09:13:06.012430 11 [Trace][][OrderReport]Tradetron 09:13:06.011 779c0098490 g01Ot C713002017 5299 IntraDayOdd ROD Buy 109.5 223 0000=OrderSuccess RR",
+        "09:13:06.012430 11 [Trace][][OrderReport]Tradetron 09:13:06.011 779c0098490 g01Ot C703002017 5299 IntraDayOdd ROD Buy 109.5 223 0000=OrderSuccess RR",
+        "09:13:06.012431 11 [Trace][][OrderReport]Tradetron 09:13:06.011 779c0098490 g01Ou C703002017 5299 IntraDayOdd ROD Buy 1x9.5 223 0000=OrderSuccess RR",
+        "09:13:06.012432 11 [Trace][][OrderReport]Tradetron 09:13:06.011 779c0098490 g01Ov C703002017 5299 IntraDayOdd ROD Buy 109.5 22x 0000=OrderSuccess RR",
+    };
+    for (const char* line : lines) {
+        parser.read(line, event, sink);
+    }
+    const ParseCounters& counters = parser.counters();
+    EXPECT_EQ(counters.lines, 5u);
+    EXPECT_EQ(counters.skipped, 1u);
+    EXPECT_EQ(counters.filtered, 1u); // C71 does not pass the default C70 filter
+    EXPECT_EQ(counters.events, 1u);
+    EXPECT_EQ(counters.warnings[Warning::MalformedPrice], 1u);
+    EXPECT_EQ(counters.warnings[Warning::MalformedShares], 1u);
+    EXPECT_EQ(counters.warnings[Warning::NoStatus], 0u);
+    EXPECT_EQ(warnings.str(),
+        "[WARN] malformed price '1x9.5' in line: " + std::string(lines[3]) + "\n"
+        "[WARN] malformed shares '22x' in line: " + std::string(lines[4]) + "\n");
+    size_t bytes = 0;
+    for (const char* line : lines) {
+        bytes += std::string_view(line).size() + 1;
+    }
+    EXPECT_EQ(counters.bytes, bytes);
+
+    OrderReplay replay(parseTimeOfDay("09:10:00").value(), parseTimeOfDay("13:24:50").value(), {MICROS_PER_SECOND}, 16);
+    replay.apply(orderEvent(33186000000, "a", 'O', 100, 1));
+    replay.apply(orderEvent(33186000001, "b", 'O', 100, 1));
+    replay.apply(orderEvent(33186000002, "a", 'C', 100, 1));
+    replay.apply(orderEvent(33186000003, "c", 'O', 100, 1));
+    EXPECT_EQ(replay.peakActiveOrders(), 2u);
+}
+
+// the lines a WarningLog wrote to <out>
+std::vector<std::string> readWarnings(FILE* out) {
+    std::vector<std::string> lines;
+    std::rewind(out);
+    char buffer[2048];
+    while (std::fgets(buffer, sizeof(buffer), out)) {
+        lines.emplace_back(buffer, std::strlen(buffer) - 1);
+    }
+    return lines;
+}
+
+TEST(CalcTest, warningLogLimitsEachKind) {
+    std::vector<std::string> lines;
+    for (int i = 0; i < 5000; ++i) {
+        lines.push_back("09:13:06.012430 11 [Trace][][OrderReport]Tradetron 09:13:06.011 779c0098490 g01Ot C703002017 5299 IntraDayOdd ROD Buy 1x" +
+            std::to_string(i) + " 223 0000=OrderSuccess RR");
+    }
+    std::string noStatus = "09:13:06.012430 11 [Trace][][OrderReport]Tradetron 09:13:06.011 779c0098490 g01Ot C703002017 5299 IntraDayOdd ROD Buy";
+    WarningLimits limits{10, 100};
+    FILE* out = std::tmpfile();
+    ASSERT_NE(out, nullptr);
+    WarningLog log(limits, out, 4); // a tiny ring, so reporting has to wait for the background thread
+    size_t sampled = 0;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&, t]() {
+            for (size_t i = t; i < lines.size(); i += 4) {
+                log.warn(Warning::MalformedPrice, "20240520.ibfs", lines[i], "1x");
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    for (const auto& line : lines) {
+        sampled += log.sampled(line);
+    }
+    log.warn(Warning::NoStatus, "20240520.ibfs", noStatus, "");
+    log.print("[WARN] failed to write event cache 20240520.ibfs.evc");
+    log.close();
+
+    EXPECT_EQ(log.count(Warning::MalformedPrice), 5000u);
+    EXPECT_EQ(log.count(Warning::NoStatus), 1u);
+    EXPECT_GT(sampled, 20u); // about 1 in 100
+    EXPECT_LT(sampled, 100u);
+    std::vector<std::string> printed = readWarnings(out);
+    std::fclose(out);
+    // the first 10 in full, past them only the sampled ones, which the burst may include
+    EXPECT_GE(printed.size(), 10 + sampled - 10 + 2);
+    EXPECT_LE(printed.size(), 10 + sampled + 2);
+    EXPECT_EQ(std::count(printed.begin(), printed.end(), "[WARN] parsing error in file 20240520.ibfs line: " + noStatus), 1);
+    EXPECT_EQ(std::count(printed.begin(), printed.end(), "[WARN] failed to write event cache 20240520.ibfs.evc"), 1);
+    EXPECT_EQ(log.summary(), "[WARN] 5001 warning(s): 1 noStatus, 5000 malformedPrice; first 10 of each kind printed, then 1 in 100\n");
+
+    WarningLog quiet(limits, std::tmpfile());
+    quiet.close();
+    EXPECT_EQ(quiet.summary(), "");
+}
+
+TEST(CalcTest, chunkWarningsReportLikeOneLog) {
+    std::vector<std::string> lines;
+    for (int i = 0; i < 3000; ++i) {
+        lines.push_back("09:13:06.012430 11 [Trace][][OrderReport]Tradetron 09:13:06.011 779c0098490 g01Ot C703002017 5299 IntraDayOdd ROD Buy 109.5 2x" +
+            std::to_string(i) + " 0000=OrderSuccess RR");
+    }
+    WarningLimits limits{50, 20};
+    FILE* whole = std::tmpfile();
+    FILE* chunked = std::tmpfile();
+    ASSERT_NE(whole, nullptr);
+    ASSERT_NE(chunked, nullptr);
+    WarningLog one(limits, whole);
+    for (const auto& line : lines) {
+        one.warn(Warning::MalformedShares, "20240520.ibfs", line, "2x");
+    }
+    one.close();
+
+    // three pieces held apart, then reported in order as replayLogParallel() does
+    WarningLog log(limits, chunked);
+    std::vector<ChunkWarnings> pieces(3, ChunkWarnings(log));
+    for (size_t i = 0; i < lines.size(); ++i) {
+        pieces[i / 1000].setEvent(i % 1000);
+        pieces[i / 1000].warn(Warning::MalformedShares, "20240520.ibfs", lines[i], "2x");
+    }
+    EXPECT_EQ(pieces[1].skippedUpTo(Warning::MalformedShares, 999), 1000 - pieces[1].held().size());
+    EXPECT_LT(pieces[1].skippedUpTo(Warning::MalformedShares, 499), 500u);
+    for (const auto& piece : pieces) {
+        EXPECT_LT(piece.held().size(), 1000u);
+        uint64_t skipped = 0;
+        for (const auto& held : piece.held()) {
+            skipped += held.skipped;
+            log.skip(held.kind, held.skipped);
+            log.warn(held.kind, "20240520.ibfs", held.line, held.field);
+        }
+        log.skip(Warning::MalformedShares, piece.skippedUpTo(Warning::MalformedShares, 1000) - skipped);
+    }
+    log.close();
+
+    EXPECT_EQ(log.count(Warning::MalformedShares), 3000u);
+    EXPECT_EQ(log.summary(), one.summary());
+    EXPECT_EQ(readWarnings(chunked), readWarnings(whole));
+    std::fclose(whole);
+    std::fclose(chunked);
+}
+
+// every field of <stats> as text, for comparing two runs over the same log
+std::string describeStats(const std::vector<LogStats>& stats) {
+    std::string text;
+    auto add = [&](double value) { text += std::to_string(value) + " "; };
+    for (const auto& s : stats) {
+        text += std::to_string(s.date) + " " + s.tt + " " + s.strategy + " ";
+        for (double value : {s.intervalSeconds, static_cast<double>(s.numberOfLogs), static_cast<double>(s.maxActiveOrders), s.meanActiveOrders,
+                s.medianActiveOrders, s.stddevActiveOrders, static_cast<double>(s.maxAmount), s.meanAmount, s.medianAmount,
+                static_cast<double>(s.minAmount), s.stddevAmount}) {
+            add(value);
+        }
+        for (const auto* values : {&s.percentiles, &s.activeOrdersPercentiles, &s.amountPercentiles}) {
+            std::for_each(values->begin(), values->end(), add);
+        }
+        for (const auto* histogram : {&s.activeOrdersHistogram, &s.amountHistogram}) {
+            std::for_each(histogram->begin(), histogram->end(), add);
+        }
+        for (const auto& symbol : s.topSymbols) {
+            text += symbol.symbol + " " + symbol.peakTime + " " + std::to_string(symbol.peakAmount) + " " + std::to_string(symbol.activeOrders) + " ";
+        }
+        for (const auto& sample : s.series) {
+            text += std::to_string(sample.checkTime) + " " + std::to_string(sample.activeOrders) + " " + std::to_string(sample.amount) + " ";
+        }
+        text += "\n";
+    }
+    return text;
+}
+
+// a generated log of two strategies with garbled prices and raw log noise
+void writeGeneratedLog(const std::string& path, uint64_t seed) {
+    LogGeneratorOptions options;
+    options.seed = seed;
+    options.orders = 20000;
+    options.strategies = {"C70", "C71"};
+    options.noiseRatio = 0.2;
+    options.malformedRatio = 0.01;
+    LogGenerator generator(options);
+    std::ofstream out(path);
+    std::string line;
+    while (generator.nextLine(line)) {
+        out << line << '\n';
+    }
+}
+
+TEST(CalcTest, replayLogParallelMatchesReplayLog) {
+    std::string dir = ::testing::TempDir() + "parallel_replay/";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+    std::string path = dir + "20240520.ibfs";
+    writeGeneratedLog(path, 3);
+
+    CalcOptions options;
+    options.intervals = {MICROS_PER_SECOND, 30 * MICROS_PER_SECOND};
+    options.filterLog = true;
+    options.filter.strategyPrefixes = {"C70", "C71"};
+    options.storeSeries = true;
+    // the stats, then the warnings printed and their summary
+    auto run = [&](size_t jobs) {
+        FILE* out = std::tmpfile();
+        WarningLog warnings(WarningLimits{20, 50}, out);
+        options.warnings = &warnings;
+        options.jobs = jobs;
+        RunMetrics metrics;
+        MappedLog log(path);
+        std::vector<LogStats> stats = jobs > 1 ? replayLogParallel(log, path, options, metrics) : replayLog(log, path, options, metrics);
+        warnings.close();
+        std::vector<std::string> printed = readWarnings(out);
+        std::fclose(out);
+        printed.push_back(warnings.summary());
+        return std::make_pair(describeStats(stats), printed);
+    };
+    auto sequential = run(1);
+    ASSERT_EQ(std::count(sequential.first.begin(), sequential.first.end(), '\n'), 4); // two strategies at two intervals
+    ASSERT_GT(sequential.second.size(), 20u);
+    for (size_t jobs : {2, 3, 8}) {
+        auto parallel = run(jobs);
+        EXPECT_EQ(parallel.first, sequential.first) << jobs << " threads";
+        EXPECT_EQ(parallel.second, sequential.second) << jobs << " threads";
+    }
+
+    // -d shares the -j threads out among the logs processed at once
+    EXPECT_EQ(jobsPerLog(8, 4), 2u);
+    EXPECT_EQ(jobsPerLog(8, 3), 2u);
+    EXPECT_EQ(jobsPerLog(2, 4), 1u);
+    EXPECT_EQ(jobsPerLog(8, 1), 8u);
+    EXPECT_EQ(jobsPerLog(8, 0), 8u);
+    writeGeneratedLog(dir + "20240521.ibfs", 4);
+    auto runDir = [&](size_t jobs) {
+        WarningLog warnings(WarningLimits{20, 50}, std::tmpfile());
+        options.warnings = &warnings;
+        options.jobs = jobs;
+        std::vector<RunMetrics> metrics;
+        std::vector<LogStats> stats = processLogDir(dir, options, metrics);
+        warnings.close();
+        EXPECT_EQ(metrics.size(), 2u);
+        return describeStats(stats);
+    };
+    std::string oneThread = runDir(1);
+    EXPECT_EQ(std::count(oneThread.begin(), oneThread.end(), '\n'), 8);
+    EXPECT_EQ(runDir(4), oneThread);
+    std::filesystem::remove_all(dir);
+}
+
+TEST(CalcTest, processLogDirSelectsDailyLogs) {
+    std::string dir = ::testing::TempDir() + "daily_logs/";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir + "20240524.ibfs"); // a directory, not a log
+    std::string log = syntheticLog(2000);
+    writeGzip(dir + "20240520.ibfs.gz", log);
+    writeGzip(dir + "20240519.ibfs.gz", log);
+    for (const char* name : {"20240521.ibfs", "20240520.ibfs.evc", "notes.txt", "2024052.ibfs", "2024052x.ibfs",
+            "20240523", "20240522.ibfs.bak.gz"}) {
+        std::ofstream(dir + name) << log;
+    }
+    EXPECT_TRUE(isDailyLog("logs/20240521.ibfs"));
+    EXPECT_TRUE(isDailyLog("20240520.ibfs.gz"));
+    EXPECT_FALSE(isDailyLog("20240520.ibfs.evc")); // replayed in place of its log, never on its own
+    EXPECT_FALSE(isDailyLog("20240523"));
+    EXPECT_EQ(dailyLogs(dir), (std::vector<std::string>{dir + "20240519.ibfs.gz", dir + "20240520.ibfs.gz", dir + "20240521.ibfs"}));
+
+    WarningLog warnings(WarningLimits{}, std::tmpfile());
+    CalcOptions options;
+    options.warnings = &warnings;
+    std::vector<RunMetrics> metrics;
+    std::vector<LogStats> stats = processLogDir(dir, options, metrics);
+    warnings.close();
+    ASSERT_EQ(metrics.size(), 3u);
+    ASSERT_EQ(stats.size(), 3u);
+    for (size_t i = 0; i < 3; ++i) {
+        EXPECT_EQ(stats[i].date, 20240519 + static_cast<int>(i)) << metrics[i].log;
+        EXPECT_EQ(metrics[i].log, dailyLogs(dir)[i]);
+        EXPECT_EQ(describeStats({stats[i]}).substr(9), describeStats({stats[0]}).substr(9)); // the same log, compressed or not
+    }
+    std::filesystem::remove_all(dir);
+}
+
+// keeps the CPU busy for <micros>, a stand-in for parsing or replaying
+void spin(int64_t micros) {
+    MetricsClock::time_point start = MetricsClock::now();
+    while (nanosSince(start) < micros * 1000) {
+    }
+}
+
+TEST(CalcTest, loopTimerSplitsByPhase) {
+    // the same sampled passes time both phases, whichever is the cheap one
+    for (bool slowParse : {true, false}) {
+        RunMetrics metrics;
+        {
+            LoopTimer timer(metrics);
+            for (int i = 0; i < 2000; ++i) {
+                timer.startParse();
+                spin(slowParse ? 20 : 1);
+                if (i % 2 == 0)
+                    continue; // read no event
+                timer.startReplay();
+                spin(slowParse ? 1 : 20);
+                timer.endReplay();
+            }
+        }
+        int64_t parse = metrics.phaseNanos[Phase::Parse];
+        int64_t replay = metrics.phaseNanos[Phase::Replay];
+        EXPECT_GT(parse + replay, 2000 * 10000); // at least the spinning
+        if (slowParse) {
+            EXPECT_GT(parse, 4 * replay) << parse << " " << replay;
+        } else {
+            EXPECT_GT(replay, 4 * parse) << parse << " " << replay;
+            EXPECT_GT(parse, 0);
+        }
+    }
+}
+
+TEST(CalcTest, runMetricsSummarizedAndStored) {
+    RunMetrics log;
+    log.log = "logs/20240520.ibfs";
+    log.phaseNanos[Phase::Parse] = 1500000000;
+    log.counters.lines = 3000;
+    log.counters.bytes = 450000;
+    log.counters.warnings[Warning::NoStatus] = 2;
+    log.events = 2500;
+    log.peakActiveOrders = 7;
+    {
+        LoopTimer timer(log);
+        for (int i = 0; i < 200; ++i) {
+            timer.startParse();
+            timer.startReplay();
+            timer.endReplay();
+        }
+    }
+    EXPECT_GE(log.phaseNanos[Phase::Replay], 0);
+    EXPECT_GE(log.phaseNanos[Phase::Parse], 1500000000);
+
+    RunMetrics total;
+    total.phaseNanos[Phase::Write] = 1000;
+    total.merge(log);
+    total.merge(log);
+    EXPECT_EQ(total.counters.lines, 6000u);
+    EXPECT_EQ(total.counters.warnings[Warning::NoStatus], 4u);
+    EXPECT_EQ(total.peakActiveOrders, 7u);
+
+    std::string json = runMetricsJson("2024-05-20 18:00:00.000", 3.5, {log}, total);
+    EXPECT_NE(json.find("\"log\": \"logs/20240520.ibfs\""), std::string::npos);
+    EXPECT_NE(json.find("\"lines\": 6000"), std::string::npos);
+    EXPECT_NE(json.find("\"noStatus\": 2"), std::string::npos);
+    EXPECT_NE(json.find("\"peakActiveOrders\": 7"), std::string::npos);
+    EXPECT_EQ(jsonString("a\"b\\c"), "\"a\\\"b\\\\c\"");
+
+    std::string path = ::testing::TempDir() + "run_metrics_test.db";
+    std::remove(path.c_str());
+    EXPECT_EQ(writeRunMetrics("2024-05-20 18:00:00.000", 3.5, {log}, total, path), 0);
+    EXPECT_EQ(writeRunMetrics("2024-05-21 18:00:00.000", 3.5, {log}, total, path), 0);
+    EXPECT_EQ(countRows(path, "run_metrics"), 2);
+    sqlite3* db;
+    ASSERT_EQ(sqlite3_open(path.c_str(), &db), SQLITE_OK);
+    sqlite3_stmt* stmt;
+    ASSERT_EQ(sqlite3_prepare_v2(db, "SELECT parseSeconds, writeSeconds, noStatusWarnings, peakActiveOrders FROM run_metrics LIMIT 1", -1, &stmt, nullptr), SQLITE_OK);
+    ASSERT_EQ(sqlite3_step(stmt), SQLITE_ROW);
+    EXPECT_GE(sqlite3_column_double(stmt, 0), 1.5);
+    EXPECT_DOUBLE_EQ(sqlite3_column_double(stmt, 1), 1e-6); // the write of the whole run
+    EXPECT_EQ(sqlite3_column_int(stmt, 2), 2);
+    EXPECT_EQ(sqlite3_column_int(stmt, 3), 7);
+    sqlite3_finalize(stmt);
+    sqlite3_close(db);
+    std::remove(path.c_str());
+}
+
 int main(int argc, char **argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
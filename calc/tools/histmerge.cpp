@@ -0,0 +1,136 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <optional>
+#include <unistd.h>
+
+#include <sqlite3.h>
+
+#include "calc.h"
+#include "histogram.h"
+#include "ticks.h"
+#include "write2db.h"
+
+/****************************
+ * 把多天的分佈合併起來, 不用重跑log
+ * Merge the per-day histograms calc stores next to LogStats (activeOrdersHistogram
+ * and amountHistogram) over a range of dates and report percentiles of the merged
+ * distribution, e.g. for a whole month:
+ * $ ./bin/histmerge -o sql/oddlot.db -t ibfs -b 20240501 -e 20240531 -s 1
+ * *************************/
+
+int printUsage(char *progname)
+{
+    std::cerr << "Usage: " << progname << " -o inputDB [-t table] [-b fromDate] [-e toDate] [-s intervalSeconds] [-P percentiles]" << std::endl;
+    std::cerr << "  -t  LogStats table to read (default ibfs)" << std::endl;
+    std::cerr << "  -b  first date (YYYYMMDD) to merge, inclusive" << std::endl;
+    std::cerr << "  -e  last date (YYYYMMDD) to merge, inclusive" << std::endl;
+    std::cerr << "  -s  merge the rows sampled every intervalSeconds (default 1), a row stored before the" << std::endl;
+    std::cerr << "      interval was recorded is merged for a day without a row at the interval" << std::endl;
+    std::cerr << "  -P  comma-separated percentiles to report (default 50,90,99,99.9)" << std::endl;
+    return 1;
+}
+
+// <scale> converts recorded values to display units (e.g. ticks to currency units)
+void showHistogram(const std::string& name, const LogLinearHistogram& histogram, const std::vector<double>& percentiles, double scale)
+{
+    std::cout << name << ": [samples=" << histogram.totalCount() << "] [max=" << histogram.max() * scale << "] ";
+    for (double p : percentiles) {
+        std::cout << "[p" << p << "=" << histogram.valueAtPercentile(p) * scale << "] ";
+    }
+    std::cout << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    std::string inputDB;
+    std::string table = "ibfs";
+    int fromDate = 0;
+    int toDate = 99999999;
+    TimeOfDay interval = MICROS_PER_SECOND;
+    std::vector<double> percentiles = {50, 90, 99, 99.9};
+    int opt;
+
+    while ((opt = getopt(argc, argv, "o:t:b:e:s:P:h")) != -1) {
+        switch(opt) {
+            case 'o':
+                inputDB = optarg;
+                break;
+            case 't':
+                table = optarg;
+                break;
+            case 'b':
+                fromDate = parseUnsigned<int>(optarg).value_or(-1);
+                break;
+            case 'e':
+                toDate = parseUnsigned<int>(optarg).value_or(-1);
+                break;
+            case 's':
+            {
+                std::optional<TimeOfDay> parsed = parseDuration(optarg);
+                if (!parsed.has_value()) {
+                    return printUsage(argv[0]);
+                }
+                interval = parsed.value();
+                break;
+            }
+            case 'P':
+            {
+                std::optional<std::vector<double>> parsed = parsePercentiles(optarg);
+                if (!parsed.has_value()) {
+                    return printUsage(argv[0]);
+                }
+                percentiles = parsed.value();
+                break;
+            }
+            default:
+                return printUsage(argv[0]);
+        }
+    }
+    if (inputDB.empty() || fromDate < 0 || toDate < 0) {
+        return printUsage(argv[0]);
+    }
+
+    sqlite3* db;
+    if (sqlite3_open_v2(inputDB.c_str(), &db, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK) {
+        std::cerr << "SQLite error: unable to open " << inputDB << ": " << sqlite3_errmsg(db) << std::endl;
+        sqlite3_close(db);
+        return 1;
+    }
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db, selectHistogramsSQL(table).c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "SQLite error: " << sqlite3_errmsg(db) << std::endl;
+        sqlite3_close(db);
+        return 1;
+    }
+    sqlite3_bind_int(stmt, 1, fromDate);
+    sqlite3_bind_int(stmt, 2, toDate);
+    sqlite3_bind_double(stmt, 3, static_cast<double>(interval) / MICROS_PER_SECOND);
+
+    LogLinearHistogram activeOrders;
+    LogLinearHistogram amount;
+    int days = 0;
+    int skipped = 0;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        auto orders = LogLinearHistogram::deserialize(static_cast<const uint8_t*>(sqlite3_column_blob(stmt, 1)), sqlite3_column_bytes(stmt, 1));
+        auto amounts = LogLinearHistogram::deserialize(static_cast<const uint8_t*>(sqlite3_column_blob(stmt, 2)), sqlite3_column_bytes(stmt, 2));
+        if (!orders.has_value() || !amounts.has_value()) {
+            ++skipped; // day stored before histograms were recorded
+            continue;
+        }
+        activeOrders.merge(orders.value());
+        amount.merge(amounts.value());
+        ++days;
+    }
+    sqlite3_finalize(stmt);
+    sqlite3_close(db);
+
+    std::cout << "merged " << days << " day(s) of " << table << " from " << fromDate << " to " << toDate;
+    if (skipped > 0) {
+        std::cout << " (" << skipped << " day(s) without histograms skipped)";
+    }
+    std::cout << std::endl;
+    showHistogram("activeOrders", activeOrders, percentiles, 1.0);
+    showHistogram("orderAmount", amount, percentiles, ticksToUnits(1));
+    return 0;
+}
@@ -0,0 +1,156 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <optional>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+
+#include "calc.h"
+#include "log_filter.h"
+#include "log_generator.h"
+
+/****************************
+ * 產生測試用的log, 格式和真的log一樣
+ * Write a synthetic log in the layout calc reads, with a given number of orders,
+ * cancel ratio, partial fills, symbols, strategies and burstiness over the
+ * 09:10-13:30 session, e.g. a day at ten times our peak volume:
+ * $ ./bin/loggen -n 20000000 -p C70,C71 -S 7 -o 20240520.ibfs
+ * The same options and seed always give the same log.
+ * *************************/
+
+int printUsage(char *progname)
+{
+    std::cerr << "Usage: " << progname << " [-o outputLog] [-n orders] [-c cancelRatio] [-m meanFills] [-y symbols] [-p strategies]" << std::endl;
+    std::cerr << "       [-b burstiness] [-B bursts] [-l meanLifeSeconds] [-N noiseRatio] [-M malformedRatio] [-S seed]" << std::endl;
+    std::cerr << "  -o  log to write (default standard output)" << std::endl;
+    std::cerr << "  -n  new orders over the session (default 100000)" << std::endl;
+    std::cerr << "  -c  share of the orders canceled instead of filled completely (default 0.3)" << std::endl;
+    std::cerr << "  -m  mean match reports per order, 1 for no partial fills (default 1.5)" << std::endl;
+    std::cerr << "  -y  number of symbols (default 200)" << std::endl;
+    std::cerr << "  -p  comma-separated strategy prefixes the orders are spread over (default C70)" << std::endl;
+    std::cerr << "  -b  share of the orders arriving in bursts (default 0.3)" << std::endl;
+    std::cerr << "  -B  number of bursts over the session (default 20)" << std::endl;
+    std::cerr << "  -l  mean seconds from an order to its cancel or last fill (default 60)" << std::endl;
+    std::cerr << "  -N  entries calc skips (heartbeats) per order entry (default 0)" << std::endl;
+    std::cerr << "  -M  share of the new orders with a malformed price (default 0)" << std::endl;
+    std::cerr << "  -S  random seed (default 1)" << std::endl;
+    return 1;
+}
+
+// Parse a non-negative number, at most <max>
+std::optional<double> parseRatio(const char* text, double max)
+{
+    char* parsed = nullptr;
+    double value = std::strtod(text, &parsed);
+    if (parsed == text || *parsed != '\0' || !(value >= 0.0 && value <= max))
+        return std::nullopt;
+    return value;
+}
+
+int main(int argc, char* argv[])
+{
+    LogGeneratorOptions options;
+    std::string outputLog;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "o:n:c:m:y:p:b:B:l:N:M:S:h")) != -1) {
+        std::optional<double> ratio;
+        std::optional<size_t> count;
+        switch(opt) {
+            case 'o':
+                outputLog = optarg;
+                break;
+            case 'n':
+                if (!(count = parseUnsigned<size_t>(optarg)).has_value())
+                    return printUsage(argv[0]);
+                options.orders = count.value();
+                break;
+            case 'c':
+                if (!(ratio = parseRatio(optarg, 1.0)).has_value())
+                    return printUsage(argv[0]);
+                options.cancelRatio = ratio.value();
+                break;
+            case 'm':
+                if (!(ratio = parseRatio(optarg, 1000.0)).has_value() || ratio.value() < 1.0)
+                    return printUsage(argv[0]);
+                options.meanFills = ratio.value();
+                break;
+            case 'y':
+                if (!(count = parseUnsigned<size_t>(optarg)).has_value() || count.value() == 0)
+                    return printUsage(argv[0]);
+                options.symbols = count.value();
+                break;
+            case 'p':
+            {
+                std::optional<std::vector<std::string>> prefixes = parseStrategyPrefixes(optarg);
+                if (!prefixes.has_value())
+                    return printUsage(argv[0]);
+                options.strategies = prefixes.value();
+                break;
+            }
+            case 'b':
+                if (!(ratio = parseRatio(optarg, 1.0)).has_value())
+                    return printUsage(argv[0]);
+                options.burstiness = ratio.value();
+                break;
+            case 'B':
+                if (!(count = parseUnsigned<size_t>(optarg)).has_value())
+                    return printUsage(argv[0]);
+                options.bursts = count.value();
+                break;
+            case 'l':
+                if (!(ratio = parseRatio(optarg, 86400.0)).has_value())
+                    return printUsage(argv[0]);
+                options.meanLifeSeconds = ratio.value();
+                break;
+            case 'N':
+                if (!(ratio = parseRatio(optarg, 1000.0)).has_value())
+                    return printUsage(argv[0]);
+                options.noiseRatio = ratio.value();
+                break;
+            case 'M':
+                if (!(ratio = parseRatio(optarg, 1.0)).has_value())
+                    return printUsage(argv[0]);
+                options.malformedRatio = ratio.value();
+                break;
+            case 'S':
+            {
+                std::optional<uint64_t> seed = parseUnsigned<uint64_t>(optarg);
+                if (!seed.has_value())
+                    return printUsage(argv[0]);
+                options.seed = seed.value();
+                break;
+            }
+            default:
+                return printUsage(argv[0]);
+        }
+    }
+
+    FILE* out = outputLog.empty() ? stdout : std::fopen(outputLog.c_str(), "w");
+    if (!out) {
+        std::cerr << "Error: unable to open " << outputLog << " for writing" << std::endl;
+        return 1;
+    }
+    static char buffer[1 << 20]; // outlives main(), stdout is flushed once more at exit
+    std::setvbuf(out, buffer, _IOFBF, sizeof(buffer));
+
+    LogGenerator generator(options);
+    std::string line;
+    size_t lines = 0;
+    bool ok = true;
+    while (ok && generator.nextLine(line)) {
+        line += '\n';
+        ok = std::fwrite(line.data(), 1, line.size(), out) == line.size();
+        ++lines;
+    }
+    ok = std::fflush(out) == 0 && ok;
+    if (out != stdout)
+        ok = std::fclose(out) == 0 && ok;
+    if (!ok) {
+        std::cerr << "Error: unable to write " << (outputLog.empty() ? "the log" : outputLog) << std::endl;
+        return 1;
+    }
+    std::cerr << "wrote " << lines << " line(s) for " << options.orders << " order(s)" << std::endl;
+    return 0;
+}